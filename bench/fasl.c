@@ -0,0 +1,153 @@
+/* fasl.c: Microbenchmark for loading images against reading text.
+ * Created: 2026-10-17
+ * Author: Aryadev Chavali
+ * License: See end of file
+ * Commentary:
+
+ * Writes an image (see fasl.h) of each file given (the examples by default),
+ * then times reading every object at the top level of the file as text,
+ * against loading its image and taking the same objects from it.  Both should
+ * give the same objects, checked by a sum over them.  Atoms are interned
+ * before timing either, as they would be by any program run before.
+ */
+
+#include "fasl.h"
+#include "gc.h"
+#include "state.h"
+
+#include <math.h>
+#include <time.h>
+
+state_t state[1];
+
+static f64 now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/// Sum over every number and atom in `obj`, so text and image can be compared.
+static u64 checksum(obj_t *obj)
+{
+  if (IS_PAIR(obj))
+    return 31 * checksum(car(obj)) + checksum(cdr(obj));
+  else if (IS_NUM(obj))
+    return as_num(obj);
+  else if (IS_ATOM(obj))
+    return atom_length(obj);
+  return 1;
+}
+
+/// Sum over every object left to read.
+static u64 read_all(void)
+{
+  u64 sum = 0;
+  obj_t *obj;
+  while (read_next(&obj))
+    sum = 31 * sum + checksum(obj);
+  return sum;
+}
+
+/// Contents of the file at `path`, `*size` bytes long.
+static char *slurp(const char *path, size_t *size)
+{
+  FILE *fp = fopen(path, "rb");
+  if (!fp)
+    FAIL("Failed to open file: '%s'", path);
+  fseek(fp, 0, SEEK_END);
+  *size = ftell(fp);
+  rewind(fp);
+  char *str = malloc(*size ? *size : 1);
+  if (!str || fread(str, 1, *size, fp) != *size)
+    FAIL("Failed to read file: '%s'", path);
+  fclose(fp);
+  return str;
+}
+
+int main(int argc, char *argv[])
+{
+  constexpr u64 ROUNDS   = 16;
+  constexpr f64 MIN_TIME = 0.01;
+  const char *examples[] = {
+      "examples/church-numerals.fp",        "examples/currying.fp",
+      "examples/demo.fp",                   "examples/factorial.fp",
+      "examples/fibonacci-functional.fp",   "examples/forsp.fp",
+      "examples/higher-order-functions.fp", "examples/tutorial.fp",
+  };
+  const char **paths = argc > 1 ? (const char **)argv + 1 : examples;
+  u64 count          = argc > 1 ? (u64)argc - 1 : ARRSIZE(examples);
+
+  state_init();
+  printf("%-36s %9s %9s %9s %9s %7s\n", "file", "bytes", "image", "text us",
+         "image us", "speedup");
+  for (u64 i = 0; i < count; ++i)
+  {
+    size_t size;
+    char *str = slurp(paths[i], &size);
+
+    // Writing the image interns every atom of the file, for both.
+    char *image       = NULL;
+    size_t image_size = 0;
+    FILE *fp          = open_memstream(&image, &image_size);
+    if (!fp)
+      FAIL("Failed to open an image in memory");
+    read_input(paths[i], str, size);
+    fasl_write(fp);
+    fclose(fp);
+
+    // Each round repeats its load until it's taken long enough to time.
+    f64 best[2] = {INFINITY, INFINITY};
+    u64 sums[2] = {0};
+    u64 repeats = 1;
+    for (u64 round = 0; round < ROUNDS; ++round)
+    {
+      for (u64 mode = 0; mode < 2; ++mode)
+      {
+        f64 elapsed;
+        for (;;)
+        {
+          f64 start = now();
+          for (u64 r = 0; r < repeats; ++r)
+          {
+            if (!mode)
+              read_input(paths[i], str, size);
+            else
+              fasl_load(paths[i], image, image_size);
+            sums[mode] = read_all();
+          }
+          elapsed = now() - start;
+          if (elapsed >= MIN_TIME || round)
+            break;
+          repeats *= 2;
+        }
+        best[mode] = MIN(best[mode], elapsed / repeats);
+        // What's been read is garbage now.
+        gc_collect();
+      }
+    }
+    if (sums[0] != sums[1])
+      FAIL("%s: Image differs from the text", paths[i]);
+
+    printf("%-36s %9lu %9lu %9.1f %9.1f %6.1fx\n", paths[i], size, image_size,
+           best[0] * 1e6, best[1] * 1e6, best[0] / best[1]);
+    fflush(stdout);
+    free(image);
+    free(str);
+  }
+
+  state_stop();
+  return 0;
+}
+
+/* Copyright (C) 2026 Aryadev Chavali
+
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the MIT License for details.
+
+ * You may distribute and modify this code under the terms of the MIT License,
+ * which you should have received a copy of along with this program.  If not,
+ * please go to <https://opensource.org/license/MIT>.
+
+ */
@@ -0,0 +1,101 @@
+/* mark-parallel.c: Microbenchmark for parallel marking of a large heap.
+ * Created: 2026-10-17
+ * Author: Aryadev Chavali
+ * License: See end of file
+ * Commentary:
+
+ * Builds a large balanced tree of pairs, which (unlike a list) has plenty of
+ * independent work to steal, then times a full collection of it with 1 to
+ * GC_MARK_THREADS_MAX_BENCH marker threads.  Nothing is garbage, so each
+ * collection is almost entirely marking.  Run it on a machine with at least as
+ * many cores as threads: otherwise it only shows the overhead.
+ */
+
+#include "gc.h"
+#include "state.h"
+
+#include <time.h>
+
+state_t state[1];
+
+#define GC_MARK_THREADS_MAX_BENCH (8)
+
+static f64 now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/** Push a complete tree of pairs of the given `depth` onto the stack.
+ */
+static void tree(u64 depth)
+{
+  if (!depth)
+  {
+    push(make_num(depth));
+    return;
+  }
+  tree(depth - 1);
+  tree(depth - 1);
+  obj_t *right = pop();
+  obj_t *left  = pop();
+  push(make_pair(left, right));
+}
+
+int main(void)
+{
+  constexpr u64 DEPTH  = 22;
+  constexpr u64 ROUNDS = 8;
+
+  state_init();
+  tree(DEPTH);
+  // Promote the tree first, so only marking is timed.
+  gc_collect();
+
+  u64 objects = (1LU << DEPTH) - 1;
+  printf("%lu objects over %lu chunks\n", objects, state->gc.pool.length);
+  printf("%8s %12s %12s %8s\n", "threads", "ms/mark", "ns/object", "speedup");
+
+  // The environment is live too, so check against the sequential mark.
+  u64 marked = 0;
+  f64 base   = 0;
+  for (u64 threads = 1; threads <= GC_MARK_THREADS_MAX_BENCH; threads *= 2)
+  {
+    gc_mark_threads(threads);
+    f64 total = 0;
+    for (u64 round = 0; round < ROUNDS; ++round)
+    {
+      f64 start = now();
+      gc_collect();
+      total += now() - start;
+    }
+    f64 mark = total / ROUNDS;
+    if (threads == 1)
+    {
+      marked = state->gc.metadata.slots_marked;
+      base   = mark;
+    }
+    else if (state->gc.metadata.slots_marked != marked)
+      FAIL("Marked %lu objects with %lu threads, expected %lu",
+           state->gc.metadata.slots_marked, threads, marked);
+
+    printf("%8lu %12.2f %12.2f %8.2f\n", threads, mark * 1e3,
+           mark * 1e9 / objects, base / mark);
+  }
+
+  state_stop();
+  return 0;
+}
+
+/* Copyright (C) 2026 Aryadev Chavali
+
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the MIT License for details.
+
+ * You may distribute and modify this code under the terms of the MIT License,
+ * which you should have received a copy of along with this program.  If not,
+ * please go to <https://opensource.org/license/MIT>.
+
+ */
@@ -0,0 +1,145 @@
+/* mark-prefetch.c: Microbenchmark for prefetching during the mark.
+ * Created: 2026-10-17
+ * Author: Aryadev Chavali
+ * License: See end of file
+ * Commentary:
+
+ * Times marking a heap of pairs with prefetch FIFOs of different depths, 0
+ * being a plain depth first mark.  The pairs make up either a long list whose
+ * cars are pairs too, or a balanced tree.  Each is laid out in the order
+ * it's linked, then with its pairs scattered across the heap at random so
+ * that almost every object is a cache miss.
+
+ * A list can only go as fast as one load after another down its cdrs, so
+ * there's little to gain there.  A tree has loads to spare.
+ */
+
+#include "gc.h"
+#include "state.h"
+
+#include <time.h>
+
+state_t state[1];
+
+static f64 now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static u64 seed = 0x9E3779B97F4A7C15;
+
+static u64 rand64(void)
+{
+  seed ^= seed << 13;
+  seed ^= seed >> 7;
+  seed ^= seed << 17;
+  return seed;
+}
+
+/** Link the `length` pairs on the stack, in the order given by `order`, into
+ * a list or a tree.  The list takes the first half, with a pair from the
+ * second half as each car.  Leaves only the root on the stack.
+ */
+static void link(const u64 *order, u64 length, bool tree)
+{
+  obj_t **pairs = state->stack.items;
+  u64 nodes     = tree ? length : length / 2;
+  for (u64 i = 0; i < nodes; ++i)
+  {
+    u64 car          = tree ? 2 * i + 1 : nodes + i;
+    u64 cdr          = tree ? 2 * i + 2 : i + 1;
+    obj_t *node      = pairs[order[i]];
+    DIRECT_CAR(node) = car < length ? pairs[order[car]] : NULL;
+    DIRECT_CDR(node) = cdr < nodes ? pairs[order[cdr]] : NULL;
+  }
+  pairs[0]            = pairs[order[0]];
+  state->stack.length = 1;
+}
+
+int main(void)
+{
+  constexpr u64 PAIRS    = 1LU << 23;
+  constexpr u64 ROUNDS   = 4;
+  constexpr u64 DEPTHS[] = {0, 2, 4, 8, 16};
+  const char *layouts[]  = {"list", "random list", "tree", "random tree"};
+
+  u64 *order = calloc(PAIRS, sizeof(*order));
+  if (!order)
+    FAIL("Failed to allocate the order of the pairs");
+
+  state_init();
+  // Never collect the old generation, only promote into it.
+  state->gc.metadata.threshold = SIZE_MAX;
+
+  printf("%lu objects, in ns per object marked at each depth\n", PAIRS);
+  printf("%12s", "layout");
+  for (u64 d = 0; d < ARRSIZE(DEPTHS); ++d)
+    printf(" %7lu", DEPTHS[d]);
+  printf("\n");
+
+  for (u64 layout = 0; layout < ARRSIZE(layouts); ++layout)
+  {
+    bool tree   = layout >= 2;
+    bool random = layout % 2;
+    for (u64 i = 0; i < PAIRS; ++i)
+    {
+      order[i] = i;
+      push(make_pair(make_num(i), NULL));
+    }
+    gc_minor();
+    // Pairs were promoted in the order they were pushed, so shuffling the
+    // order shuffles the pairs through the heap.
+    for (u64 i = PAIRS - 1; random && i > 0; --i)
+    {
+      u64 j    = rand64() % (i + 1);
+      u64 tmp  = order[i];
+      order[i] = order[j];
+      order[j] = tmp;
+    }
+    link(order, PAIRS, tree);
+
+    printf("%12s", layouts[layout]);
+    u64 marked = 0;
+    for (u64 d = 0; d < ARRSIZE(DEPTHS); ++d)
+    {
+      gc_mark_prefetch(DEPTHS[d]);
+      f64 total = 0;
+      for (u64 round = 0; round < ROUNDS; ++round)
+      {
+        gc_sweep();
+        f64 start = now();
+        gc_collect();
+        total += now() - start;
+      }
+
+      if (!d)
+        marked = state->gc.metadata.slots_marked;
+      else if (state->gc.metadata.slots_marked != marked)
+        FAIL("Marked %lu objects with a depth of %lu, expected %lu",
+             state->gc.metadata.slots_marked, DEPTHS[d], marked);
+      printf(" %7.2f", total * 1e9 / (ROUNDS * marked));
+      fflush(stdout);
+    }
+    printf("\n");
+    // Everything goes in the next collection.
+    state->stack.length = 0;
+  }
+
+  free(order);
+  state_stop();
+  return 0;
+}
+
+/* Copyright (C) 2026 Aryadev Chavali
+
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the MIT License for details.
+
+ * You may distribute and modify this code under the terms of the MIT License,
+ * which you should have received a copy of along with this program.  If not,
+ * please go to <https://opensource.org/license/MIT>.
+
+ */
@@ -0,0 +1,73 @@
+/* mark.c: Microbenchmark for the mark phase as the chunk pool grows.
+ * Created: 2026-10-17
+ * Author: Aryadev Chavali
+ * License: See end of file
+ * Commentary:
+
+ * Builds a list spanning an increasing number of chunks and times marking
+ * it.  If finding the chunk of an object is constant time, the time per object
+ * should stay flat regardless of the chunk count.
+ */
+
+#include "gc.h"
+#include "state.h"
+
+#include <time.h>
+
+state_t state[1];
+
+static f64 now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(void)
+{
+  constexpr u64 MAX_CHUNKS = 1024;
+  constexpr u64 ROUNDS     = 8;
+
+  state_init();
+  // Root the list in the operand stack while it's built.
+  push(NULL);
+
+  printf("%8s %12s %12s\n", "chunks", "objects", "ns/object");
+  u64 objects = 0;
+  for (u64 chunks = 1; chunks <= MAX_CHUNKS; chunks *= 2)
+  {
+    for (; objects < chunks * (GC_CHUNK_SLOTS - GC_CHUNK_FIRST_SLOT); ++objects)
+      state->stack.items[0] =
+          make_pair(make_num(objects), state->stack.items[0]);
+    // Promote the list first, so only marking is timed.
+    gc_minor();
+
+    f64 total = 0;
+    for (u64 round = 0; round < ROUNDS; ++round)
+    {
+      // Nothing is garbage and the nursery is empty, so this is all marking
+      // (and sweeping the bitmaps of the last round).
+      f64 start = now();
+      gc_collect();
+      total += now() - start;
+    }
+
+    printf("%8lu %12lu %12.2f\n", state->gc.pool.length, objects,
+           total * 1e9 / (ROUNDS * objects));
+  }
+
+  state_stop();
+  return 0;
+}
+
+/* Copyright (C) 2026 Aryadev Chavali
+
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the MIT License for details.
+
+ * You may distribute and modify this code under the terms of the MIT License,
+ * which you should have received a copy of along with this program.  If not,
+ * please go to <https://opensource.org/license/MIT>.
+
+ */
@@ -0,0 +1,286 @@
+/* read.c: Microbenchmark for reading large inputs.
+ * Created: 2026-10-17
+ * Author: Aryadev Chavali
+ * License: See end of file
+ * Commentary:
+
+ * Generates the given number of MiB (64 by default) of input of each kind
+ * below, then times lexing all of it with each lexing kernel, and reading all
+ * of it into objects:
+ * - numbers: lines of integers, as in a data file.
+ * - atoms: lines of words of different lengths.
+ * - nested: small trees of lists, with quotes and directives.
+ * - comments: indented code under long comments, mostly skipped.
+ * - mixed: each line is one of the above at random.
+ * Lexing alone only counts tokens.  Every kernel should find the same tokens
+ * and read the same objects, checked by a sum over them.  Lexing is also timed
+ * a character at a time, as it was before the kernels, as a baseline.
+ */
+
+#include "gc.h"
+#include "state.h"
+
+#include <math.h>
+#include <stdarg.h>
+#include <time.h>
+
+state_t state[1];
+
+static f64 now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static u64 seed = 0x9E3779B97F4A7C15;
+
+static u64 rand64(void)
+{
+  seed ^= seed << 13;
+  seed ^= seed >> 7;
+  seed ^= seed << 17;
+  return seed;
+}
+
+typedef enum
+{
+  KIND_NUMBERS,
+  KIND_ATOMS,
+  KIND_NESTED,
+  KIND_COMMENTS,
+  KIND_MIXED,
+} kind_t;
+
+static const char *kinds[] = {"numbers", "atoms", "nested", "comments",
+                              "mixed"};
+
+typedef struct
+{
+  char *str;
+  size_t length, capacity;
+} input_t;
+
+static void emit(input_t *input, const char *fmt, ...)
+{
+  va_list args;
+  va_start(args, fmt);
+  size_t left = input->capacity - input->length;
+  int n       = vsnprintf(input->str + input->length, left, fmt, args);
+  va_end(args);
+  if (n < 0 || (size_t)n >= left)
+    FAIL("Input overflowed its buffer");
+  input->length += n;
+}
+
+static void emit_word(input_t *input)
+{
+  static const char *words[] = {"x",      "cons",       "print", "env",
+                                "lambda", "fibonacci",  "if",    "cdr",
+                                "foldl",  "accumulator"};
+  emit(input, "%s ", words[rand64() % ARRSIZE(words)]);
+}
+
+/** Emit a line of input, a list at the top level, of kind `kind`.
+ */
+static void emit_line(input_t *input, kind_t kind)
+{
+  if (kind == KIND_MIXED)
+    kind = rand64() % KIND_MIXED;
+  switch (kind)
+  {
+  case KIND_NUMBERS:
+    emit(input, "(");
+    for (u64 i = 0; i < 16; ++i)
+      emit(input, "%ld ", (i64)(rand64() % 2000001) - 1000000);
+    emit(input, ")\n");
+    break;
+  case KIND_ATOMS:
+    emit(input, "(");
+    for (u64 i = 0; i < 16; ++i)
+      emit_word(input);
+    emit(input, ")\n");
+    break;
+  case KIND_NESTED:
+    emit(input, "(");
+    for (u64 i = 0; i < 4; ++i)
+    {
+      emit(input, "('");
+      emit_word(input);
+      emit(input, "(^x $y (%lu ", rand64() % 100);
+      emit_word(input);
+      emit(input, ")) ) ");
+    }
+    emit(input, ")\n");
+    break;
+  case KIND_COMMENTS:
+    emit(input, "; A comment about the code below, long enough to be worth "
+                "skipping.\n");
+    emit(input, "        ;; and another, under it\n");
+    emit(input, "(\n    ");
+    emit_word(input);
+    emit(input, "\n        ");
+    emit_word(input);
+    emit(input, "\n)\n\n");
+    break;
+  case KIND_MIXED:
+  default:
+    break;
+  }
+}
+
+/** Count the tokens left in the input with the lexer alone, as `read` would
+ * find them but making no objects.
+ */
+static u64 lex(void)
+{
+  u64 tokens = 0;
+  for (skip_white_and_comments(); state->reader->pos < state->reader->len;
+       skip_white_and_comments())
+  {
+    size_t word = lex_word();
+    state->reader->pos += word ? word : 1;
+    ++tokens;
+  }
+  return tokens;
+}
+
+/** Count the tokens left in the input as the lexer did before kernels: testing
+ * each character of whitespace and of a scalar in turn.
+ */
+static u64 lex_baseline(void)
+{
+  const char *str = state->reader->str;
+  size_t pos      = state->reader->pos;
+  size_t len      = state->reader->len;
+  u64 tokens      = 0;
+  for (;;)
+  {
+    while (pos < len)
+    {
+      if (is_white(str[pos]))
+        ++pos;
+      else if (str[pos] == ';')
+      {
+        const char *end = memchr(str + pos, '\n', len - pos);
+        pos             = end ? (size_t)(end - str) : len;
+      }
+      else
+        break;
+    }
+    if (pos >= len)
+      break;
+
+    size_t word = 0;
+    while (pos + word < len && !is_punctuation(str[pos + word]))
+      ++word;
+    pos += word ? word : 1;
+    ++tokens;
+  }
+  state->reader->pos = pos;
+  return tokens;
+}
+
+/// Sum over every number and atom in `obj`, so kernels can be compared.
+static u64 checksum(obj_t *obj)
+{
+  if (IS_PAIR(obj))
+    return 31 * checksum(car(obj)) + checksum(cdr(obj));
+  else if (IS_NUM(obj))
+    return as_num(obj);
+  else if (IS_ATOM(obj))
+    return atom_length(obj);
+  return 1;
+}
+
+int main(int argc, char *argv[])
+{
+  constexpr u64 ROUNDS  = 4;
+  const char *kernels[] = {"baseline", "scalar", "sse2", "avx2"};
+
+  u64 mib = argc > 1 ? strtoull(argv[1], NULL, 10) : 64;
+  if (!mib)
+    FAIL("usage: %s [MiB of input]", argv[0]);
+
+  state_init();
+  input_t inputs[ARRSIZE(kinds)] = {0};
+  for (u64 k = 0; k < ARRSIZE(kinds); ++k)
+  {
+    input_t *input  = &inputs[k];
+    input->capacity = (mib << 20) + 4096;
+    input->str      = malloc(input->capacity);
+    if (!input->str)
+      FAIL("Failed to allocate %lu MiB of input", mib);
+    while (input->length < mib << 20)
+      emit_line(input, k);
+  }
+
+  printf("%lu MiB of each, in MiB per second at best\n", mib);
+  // Each kernel should find the same as the scalar one.
+  u64 expected[2][ARRSIZE(kinds)] = {0};
+  for (u64 mode = 0; mode < 2; ++mode)
+  {
+    printf("%8s", mode ? "read" : "lex");
+    for (u64 k = 0; k < ARRSIZE(kinds); ++k)
+      printf(" %8s", kinds[k]);
+    printf("\n");
+
+    for (u64 l = 0; l < ARRSIZE(kernels); ++l)
+    {
+      // Only lexing has a baseline: reading has changed since in other ways.
+      bool baseline = !l;
+      if (baseline && mode)
+        continue;
+      else if (!baseline && !lex_kernel(kernels[l]))
+      {
+        printf("%8s %8s\n", kernels[l], "n/a");
+        continue;
+      }
+      printf("%8s", kernels[l]);
+      for (u64 k = 0; k < ARRSIZE(kinds); ++k)
+      {
+        input_t *input = &inputs[k];
+        f64 best       = INFINITY;
+        u64 sum        = 0;
+        for (u64 round = 0; round < ROUNDS; ++round)
+        {
+          read_input(kinds[k], input->str, input->length);
+          f64 start = now();
+          if (baseline)
+            sum += lex_baseline();
+          else if (!mode)
+            sum += lex();
+          else
+            while (skip_white_and_comments(),
+                   state->reader->pos < input->length)
+              sum += checksum(read());
+          best = MIN(best, now() - start);
+        }
+        if (l == mode)
+          expected[mode][k] = sum;
+        else if (sum != expected[mode][k])
+          FAIL("%s found %s differently", kernels[l], kinds[k]);
+        printf(" %8.1f", input->length / best / (1LU << 20));
+        fflush(stdout);
+      }
+      printf("\n");
+    }
+  }
+
+  for (u64 k = 0; k < ARRSIZE(kinds); ++k)
+    free(inputs[k].str);
+  state_stop();
+  return 0;
+}
+
+/* Copyright (C) 2026 Aryadev Chavali
+
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the MIT License for details.
+
+ * You may distribute and modify this code under the terms of the MIT License,
+ * which you should have received a copy of along with this program.  If not,
+ * please go to <https://opensource.org/license/MIT>.
+
+ */
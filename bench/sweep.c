@@ -0,0 +1,169 @@
+/* sweep.c: Microbenchmark for sweeping a large heap.
+ * Created: 2026-10-17
+ * Author: Aryadev Chavali
+ * License: See end of file
+ * Commentary:
+
+ * Fills a heap of the given number of GiB (2 by default) with a live list,
+ * then times sweeping it with each sweep kernel under different patterns of
+ * marks.  The marks are written by hand rather than by a collection, so only
+ * sweeping is timed:
+ * - live: everything is marked.
+ * - dead: nothing is marked.
+ * - half: every slot is marked at random with even odds.
+ * - empty: nothing is live, as in a chunk already swept of everything.
+ * - mixed: each chunk is one of the above at random.
+ */
+
+#include "gc.h"
+#include "state.h"
+
+#include <time.h>
+
+state_t state[1];
+
+static f64 now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static u64 seed = 0x9E3779B97F4A7C15;
+
+static u64 rand64(void)
+{
+  seed ^= seed << 13;
+  seed ^= seed >> 7;
+  seed ^= seed << 17;
+  return seed;
+}
+
+typedef enum
+{
+  PATTERN_LIVE,
+  PATTERN_DEAD,
+  PATTERN_HALF,
+  PATTERN_EMPTY,
+  PATTERN_MIXED,
+} pattern_t;
+
+static const char *patterns[] = {"live", "dead", "half", "empty", "mixed"};
+
+/** Restore chunk `c` to its `live` bits as built, then mark it by `pattern`.
+ */
+static void prepare(gc_chunk_t *c, const u64 *live, pattern_t pattern)
+{
+  if (pattern == PATTERN_MIXED)
+    pattern = rand64() % PATTERN_MIXED;
+  for (u64 w = 0; w < GC_CHUNK_MARK_WORDS; ++w)
+  {
+    c->live_bits[w] = pattern == PATTERN_EMPTY ? 0 : live[w];
+    switch (pattern)
+    {
+    case PATTERN_LIVE:
+      c->mark_bits[w] = live[w];
+      break;
+    case PATTERN_HALF:
+      c->mark_bits[w] = live[w] & rand64();
+      break;
+    case PATTERN_DEAD:
+    case PATTERN_EMPTY:
+    case PATTERN_MIXED:
+    default:
+      c->mark_bits[w] = 0;
+      break;
+    }
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  constexpr u64 ROUNDS = 4;
+  const char *kernels[] = {"scalar", "sse4.2", "avx2"};
+
+  u64 gib = argc > 1 ? strtoull(argv[1], NULL, 10) : 2;
+  if (!gib)
+    FAIL("usage: %s [GiB of heap]", argv[0]);
+
+  state_init();
+  // Never collect the old generation, only promote into it.
+  state->gc.metadata.threshold = SIZE_MAX;
+  push(NULL);
+  u64 chunks = (gib << 30) / GC_CHUNK_SIZE;
+  while (state->gc.pool.length < chunks)
+  {
+    for (u64 i = 0; i < GC_NURSERY_SLOTS; ++i)
+      state->stack.items[0] = make_pair(NULL, state->stack.items[0]);
+    gc_minor();
+  }
+
+  gc_pool_t *pool = &state->gc.pool;
+  u64 *saved      = calloc(pool->length, sizeof(pool->chunks[0]->live_bits));
+  if (!saved)
+    FAIL("Failed to allocate a copy of the live bits");
+  for (u64 i = 0; i < pool->length; ++i)
+    memcpy(saved + i * GC_CHUNK_MARK_WORDS, pool->chunks[i]->live_bits,
+           sizeof(pool->chunks[i]->live_bits));
+
+  f64 bytes = (f64)pool->length * GC_CHUNK_SIZE;
+  printf("%.2f GiB over %lu chunks, in GiB of heap swept per second\n",
+         bytes / (1LU << 30), pool->length);
+  printf("%8s", "kernel");
+  for (u64 p = 0; p < ARRSIZE(patterns); ++p)
+    printf(" %8s", patterns[p]);
+  printf("\n");
+
+  // Each kernel should free the same slots as the scalar one.
+  size_t expected[ARRSIZE(patterns)] = {0};
+  for (u64 k = 0; k < ARRSIZE(kernels); ++k)
+  {
+    if (!gc_sweep_kernel(kernels[k]))
+    {
+      printf("%8s %8s\n", kernels[k], "n/a");
+      continue;
+    }
+    printf("%8s", kernels[k]);
+    for (u64 p = 0; p < ARRSIZE(patterns); ++p)
+    {
+      f64 total    = 0;
+      size_t freed = 0;
+      for (u64 round = 0; round < ROUNDS; ++round)
+      {
+        seed = 0x9E3779B97F4A7C15 + round;
+        for (u64 i = 0; i < pool->length; ++i)
+          prepare(pool->chunks[i], saved + i * GC_CHUNK_MARK_WORDS, p);
+        state->gc.sweeper.next = 0;
+        state->gc.sweeper.end  = pool->length;
+
+        f64 start = now();
+        freed += gc_sweep();
+        total += now() - start;
+      }
+      if (!k)
+        expected[p] = freed;
+      else if (freed != expected[p])
+        FAIL("%s freed %lu slots on %s, expected %lu", kernels[k], freed,
+             patterns[p], expected[p]);
+      printf(" %8.2f", ROUNDS * bytes / total / (1LU << 30));
+      fflush(stdout);
+    }
+    printf("\n");
+  }
+
+  free(saved);
+  state_stop();
+  return 0;
+}
+
+/* Copyright (C) 2026 Aryadev Chavali
+
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the MIT License for details.
+
+ * You may distribute and modify this code under the terms of the MIT License,
+ * which you should have received a copy of along with this program.  If not,
+ * please go to <https://opensource.org/license/MIT>.
+
+ */
@@ -0,0 +1,34 @@
+(
+  ($x x)                       $force
+  (force cswap $_ force)       $if
+  ($f $t $c $fn ^f ^t ^c fn)   $endif
+
+  ; Y-Combinator
+  ($f
+    ($x (^x x) f)
+    ($x (^x x) f)
+    force
+  ) $Y
+  ($g (^g Y)) $rec
+
+  ; A channel reads data apart from the program, an object at a time, so
+  ; only as much of it as the largest object is held at once.  `open` takes
+  ; an atom naming a file, or a file descriptor (0 for stdin).  `read-from`
+  ; pushes the next object then t, or () then () at the end.
+  ;
+  ; The data is on stdin, so run this as
+  ;   ./bin/forsp examples/channels.fp < examples/channels.txt
+
+  ; print every object left on a channel, returning how many there were
+  ($self $n $ch
+    ^ch read-from $more $obj
+    ^if (^more '() eq)
+      (^n)
+      (^obj print ^ch ^n 0 1 - - self)
+    endif
+  ) rec $drain
+
+  0 open $ch
+  ^ch 0 drain print
+  ^ch close
+)
@@ -7,6 +7,12 @@
 #ifndef COMMON_H
 #define COMMON_H
 
+// POSIX (threads, clocks, file descriptors) and the extensions to mmap the GC
+// relies on (MAP_ANONYMOUS, MAP_NORESERVE, MADV_DONTNEED), which strict C23
+// hides.  Every file includes this first, so it's defined before any system
+// header.
+#define _DEFAULT_SOURCE
+
 #include <assert.h>
 #include <inttypes.h>
 #include <stdbool.h>
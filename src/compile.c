@@ -0,0 +1,290 @@
+/* compile.c: Compilation of closure bodies into threaded bytecode.
+ * Created: 2026-10-17
+ * Author: Aryadev Chavali
+ * License: See end of file
+ */
+
+#include "compile.h"
+#include "compute.h"
+#include "primitives.h"
+#include "state.h"
+
+/******************************************************************************
+ * Code objects                                                               *
+ ******************************************************************************/
+
+static code_t *code_new(obj_t *source, code_t *parent, bool dynamic)
+{
+  code_t *code = calloc(1, sizeof(*code));
+  if (!code)
+    FAIL("Failed to allocate code for compilation");
+  code->source  = source;
+  code->parent  = parent;
+  code->dynamic = dynamic;
+  if (parent)
+  {
+    code->parent_defs = parent->defs.length;
+    code->base        = parent->base;
+  }
+  vec_push(&state->codes, make_code(code));
+  vec_push(&state->codes_fresh, make_code(code));
+  return code;
+}
+
+void code_stop(void)
+{
+  for (u64 i = 0; i < state->codes.length; ++i)
+  {
+    code_t *code = as_code(state->codes.items[i]);
+    vec_stop(&code->defs);
+    free(code->insns);
+    free(code);
+  }
+  vec_stop(&state->codes);
+  vec_stop(&state->codes_fresh);
+}
+
+void code_release(code_t *code)
+{
+  // Any code made since, nested or not, may refer back to it.
+  vec_t *codes = &state->codes;
+  if (!codes->length || as_code(codes->items[codes->length - 1]) != code)
+    return;
+  --codes->length;
+
+  vec_t *fresh = &state->codes_fresh;
+  u64 kept     = 0;
+  for (u64 i = 0; i < fresh->length; ++i)
+    if (as_code(fresh->items[i]) != code)
+      fresh->items[kept++] = fresh->items[i];
+  fresh->length = kept;
+
+  vec_stop(&code->defs);
+  free(code->insns);
+  free(code);
+}
+
+void code_visit(code_t *code, void (*visit)(obj_t **))
+{
+  visit(&code->source);
+  visit(&code->base);
+  for (u64 i = 0; i < code->length; ++i)
+    visit(&code->insns[i].arg);
+}
+
+/******************************************************************************
+ * Resolution                                                                 *
+ ******************************************************************************/
+
+typedef struct
+{
+  enum
+  {
+    RESOLVE_DYNAMIC,
+    RESOLVE_LOCAL,
+    RESOLVE_PRIM,
+  } kind;
+  u64 offset;
+  obj_t *prim;
+} resolution_t;
+
+/** Resolve `atom` against the environment `code` will have at the current
+ * point of its compilation.
+
+ * Bindings are walked newest first, exactly as `env_find` would at runtime:
+ * our own definitions so far, then our parent's at the point we were
+ * constructed, and so on up to the base environment.
+ */
+static resolution_t resolve(code_t *code, obj_t *atom)
+{
+  resolution_t res = {.kind = RESOLVE_DYNAMIC};
+  if (code->dynamic)
+    return res;
+
+  u64 defs = code->defs.length;
+  for (code_t *iter = code; iter; defs = iter->parent_defs, iter = iter->parent)
+  {
+    for (u64 i = defs; i > 0; --i, ++res.offset)
+    {
+      if (iter->defs.items[i - 1] == atom)
+      {
+        res.kind = RESOLVE_LOCAL;
+        return res;
+      }
+    }
+  }
+
+  for (obj_t *env = code->base; IS_PAIR(env);
+       env = DIRECT_CDR(env), ++res.offset)
+  {
+    obj_t *kv = DIRECT_CAR(env);
+    if (DIRECT_CAR(kv) != atom)
+      continue;
+    res.kind = IS_PRIM(DIRECT_CDR(kv)) ? RESOLVE_PRIM : RESOLVE_LOCAL;
+    res.prim = DIRECT_CDR(kv);
+    return res;
+  }
+
+  return (resolution_t){.kind = RESOLVE_DYNAMIC};
+}
+
+static inline bool resolves_to(code_t *code, obj_t *atom, prim_t *prim)
+{
+  auto res = resolve(code, atom);
+  return res.kind == RESOLVE_PRIM && as_prim(res.prim) == prim;
+}
+
+/******************************************************************************
+ * Compilation                                                                *
+ ******************************************************************************/
+
+static inline insn_t *emit(code_t *code, opcode_t op, obj_t *arg)
+{
+  // Opcodes are swapped out for handler addresses by `compute_thread`.
+  insn_t *insn = code->insns + code->length++;
+  *insn = (insn_t){.op = (const void *)(uintptr_t)op, .arg = arg};
+  return insn;
+}
+
+static inline bool last_op_is(code_t *code, opcode_t op)
+{
+  return code->length &&
+         code->insns[code->length - 1].op == (const void *)(uintptr_t)op;
+}
+
+/** Emit the instruction for a reference to `atom`, calling it if `call` or
+ * else just pushing its value.
+ */
+static void emit_reference(code_t *code, obj_t *atom, bool call)
+{
+  auto res = resolve(code, atom);
+  switch (res.kind)
+  {
+  case RESOLVE_LOCAL:
+    emit(code, call ? OP_CALL_LOCAL : OP_PUSH_LOCAL, atom)->offset =
+        res.offset;
+    break;
+  case RESOLVE_PRIM:
+    emit(code, call ? OP_PRIM : OP_PUSH_PRIM, atom)->value = res.prim;
+    break;
+  case RESOLVE_DYNAMIC:
+  default:
+    emit(code, call ? OP_CALL : OP_PUSH, atom);
+    break;
+  }
+}
+
+code_t *code_ensure(code_t *code)
+{
+  if (code->insns)
+    return code;
+
+  // Every member of the body produces at most one instruction, plus OP_RET.
+  u64 capacity = 1;
+  for (obj_t *iter = code->source; IS_PAIR(iter); iter = DIRECT_CDR(iter))
+    ++capacity;
+  code->insns = malloc(capacity * sizeof(code->insns[0]));
+  if (!code->insns)
+    FAIL("Failed to allocate code for compilation");
+
+  for (obj_t *iter = code->source; IS_PAIR(iter); iter = DIRECT_CDR(iter))
+  {
+    obj_t *cmd = DIRECT_CAR(iter);
+    switch (get_tag(cmd))
+    {
+    case TAG_ATOM:
+    {
+      if (cmd != state->atom_quote)
+      {
+        emit_reference(code, cmd, true);
+        break;
+      }
+      else if (!DIRECT_CDR(iter))
+      {
+        emit(code, OP_NO_QUOTE, NULL);
+        break;
+      }
+
+      iter        = DIRECT_CDR(iter);
+      obj_t *data = DIRECT_CAR(iter);
+      obj_t *next = DIRECT_CDR(iter);
+
+      // `'x pop` and `'x push` (i.e. `$x` and `^x`) are fused when pop and
+      // push are the primitives we expect.
+      if (IS_ATOM(data) && next && IS_ATOM(DIRECT_CAR(next)))
+      {
+        if (resolves_to(code, DIRECT_CAR(next), prim_pop))
+        {
+          emit(code, OP_DEFINE, data);
+          vec_push(&code->defs, data);
+          iter = next;
+          break;
+        }
+        else if (resolves_to(code, DIRECT_CAR(next), prim_push))
+        {
+          emit_reference(code, data, false);
+          iter = next;
+          break;
+        }
+      }
+      emit(code, OP_CONST, data);
+    }
+    break;
+    case TAG_NIL:
+    case TAG_PAIR:
+    {
+      code_t *nested = code_new(cmd, code, code->dynamic);
+      emit(code, OP_CLOSURE_LAZY, make_code(nested));
+    }
+    break;
+    case TAG_NUM:
+    case TAG_CLOS:
+    case TAG_PRIM:
+    case TAG_CODE:
+    default:
+      emit(code, OP_CONST, cmd);
+      break;
+    }
+  }
+
+  // A call as the very last member of a body is a tail call.
+  if (last_op_is(code, OP_CALL))
+    code->insns[code->length - 1].op = (const void *)(uintptr_t)OP_TAILCALL;
+  else if (last_op_is(code, OP_CALL_LOCAL))
+    code->insns[code->length - 1].op =
+        (const void *)(uintptr_t)OP_TAILCALL_LOCAL;
+  emit(code, OP_RET, NULL);
+
+  compute_thread(code);
+  // The instructions hold on to objects from the body, which may be young.
+  vec_push(&state->codes_fresh, make_code(code));
+  return code;
+}
+
+code_t *compile(obj_t *body, obj_t *env)
+{
+  code_t *code = code_new(body, NULL, false);
+  code->base   = env;
+  return code_ensure(code);
+}
+
+code_t *code_twin(code_t *code)
+{
+  if (code->dynamic)
+    return code;
+  if (!code->twin)
+    code->twin = code_new(code->source, NULL, true);
+  return code->twin;
+}
+
+/* Copyright (C) 2026 Aryadev Chavali
+
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the MIT License for details.
+
+ * You may distribute and modify this code under the terms of the MIT License,
+ * which you should have received a copy of along with this program.  If not,
+ * please go to <https://opensource.org/license/MIT>.
+
+ */
@@ -0,0 +1,132 @@
+/* compile.h: Compilation of closure bodies into threaded bytecode.
+ * Created: 2026-10-17
+ * Author: Aryadev Chavali
+ * License: See end of file
+ *
+ * A closure body is a list which `eval` would otherwise walk cell by cell.
+ * Here we compile it once into a flat array of instructions for the virtual
+ * machine in compute.c.  Nested bodies are compiled lazily, the first time
+ * their closure is constructed.
+ *
+ * Atoms are resolved at compile time where possible.  Each body records the
+ * atoms it binds through `'x pop` (i.e. `$x`), so a reference can be turned
+ * into an offset into the environment it will run under, and primitives into
+ * constants.  If a frame's environment is ever changed in any other way (a
+ * `pop` with a computed key, say) the VM marks that frame as dynamic and falls
+ * back to `env_find`.
+ */
+
+#ifndef COMPILE_H
+#define COMPILE_H
+
+#include "common.h"
+#include "obj.h"
+#include "vec.h"
+
+typedef enum Opcode
+{
+  OP_CONST = 0,      // push `arg`
+  OP_CLOSURE_LAZY,   // compile code `arg`, then rewrite this as OP_CLOSURE
+  OP_CLOSURE,        // push a closure of code `arg` over the current env
+  OP_CALL,           // lookup atom `arg` and call its value
+  OP_TAILCALL,       // OP_CALL, reusing the current frame for closures
+  OP_CALL_LOCAL,     // call the value `offset` bindings into the env
+  OP_TAILCALL_LOCAL, // OP_CALL_LOCAL, reusing the current frame for closures
+  OP_PRIM,           // call primitive `value`, the binding of atom `arg`
+  OP_PUSH,           // lookup atom `arg` and push its value (`'x push`)
+  OP_PUSH_LOCAL,     // OP_PUSH, via the value `offset` bindings into the env
+  OP_PUSH_PRIM,      // OP_PUSH, where `arg` is bound to primitive `value`
+  OP_DEFINE,         // bind atom `arg` to the top of the stack (`'x pop`)
+  OP_RET,            // return from the current frame
+  OP_NO_QUOTE,       // quote with no data following it
+
+  NUM_OPCODES,
+} opcode_t;
+
+/** A single instruction.
+ * `op`: address of the handler in the VM dispatch loop (see `compute_thread`).
+ * `arg`: operand, see `opcode_t`.  Resolved references keep their atom here
+ * for when a frame goes dynamic.
+ * `offset`: number of bindings to skip for local references.  The environment
+ * is an association list, so a lookup still walks `offset` cdrs: it's linear
+ * in how far out the binding is, though without comparing any atoms.
+ * `value`: resolved value for primitive references.
+ */
+typedef struct insn
+{
+  const void *op;
+  obj_t *arg;
+  union
+  {
+    u64 offset;
+    obj_t *value;
+  };
+} insn_t;
+
+/** A closure body, compiled or waiting to be.
+ * Code is never collected: it lives until `code_stop` is called, bar top level
+ * code released by `code_release`.  Everything it holds on to is a GC root (see
+ * `code_visit`).
+ * `source`: body this code is compiled from (for printing).
+ * `parent`: code this body is nested in, NULL at the top level.
+ * `parent_defs`: number of `parent->defs` in effect when this is constructed.
+ * `base`: environment top level code is compiled under.
+ * `dynamic`: resolve every atom at runtime (see `code_twin`).
+ * `twin`: the dynamic version of this code, if needed.
+ * `defs`: atoms statically bound by this body, in order.
+ * `length`: number of instructions.
+ * `insns`: the instructions ending with OP_RET, NULL until compiled.
+ */
+struct code
+{
+  obj_t *source;
+  code_t *parent;
+  u64 parent_defs;
+  obj_t *base;
+  bool dynamic;
+  code_t *twin;
+  vec_t defs;
+  u64 length;
+  insn_t *insns;
+};
+
+/** Compile `body` as top level code running under `env`.
+ */
+code_t *compile(obj_t *body, obj_t *env);
+
+/** Compile `code` if it hasn't been yet, returning it.
+ */
+code_t *code_ensure(code_t *code);
+
+/** Get the dynamic twin of `code`.
+ * Closures constructed by a dynamic frame can't trust the static environment
+ * layout either, so they use a version of the code without local offsets.
+ */
+code_t *code_twin(code_t *code);
+
+/** Free top level `code` from `compile` once it's finished running, unless
+ * code made since may refer to it, such as the code of its nested bodies.
+ */
+void code_release(code_t *code);
+
+/** Call `visit` on every object `code` holds on to, for the GC.
+ */
+void code_visit(code_t *code, void (*visit)(obj_t **));
+
+/** Free all code compiled so far.
+ */
+void code_stop(void);
+
+#endif
+
+/* Copyright (C) 2026 Aryadev Chavali
+
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the MIT License for details.
+
+ * You may distribute and modify this code under the terms of the MIT License,
+ * which you should have received a copy of along with this program.  If not,
+ * please go to <https://opensource.org/license/MIT>.
+
+ */
@@ -5,6 +5,8 @@
  */
 
 #include "compute.h"
+#include "compile.h"
+#include "primitives.h"
 #include "state.h"
 
 /******************************************************************************
@@ -16,7 +18,7 @@ static inline bool fstack_available()
   return state->fstack.length > 0;
 }
 
-static inline void fstack_push(obj_t *comp, obj_t *env)
+static inline frame_t *fstack_push(frame_t frame)
 {
   if (state->fstack.capacity - state->fstack.length == 0)
   {
@@ -26,11 +28,11 @@ static inline void fstack_push(obj_t *comp, obj_t *env)
                 state->fstack.capacity * sizeof(state->fstack.frames[0]));
   }
 
-  state->fstack.frames[state->fstack.length++] =
-      (clos_t){.body = comp, .env = env};
+  state->fstack.frames[state->fstack.length] = frame;
+  return &state->fstack.frames[state->fstack.length++];
 }
 
-static inline clos_t *fstack_peek(void)
+static inline frame_t *fstack_peek(void)
 {
   return &state->fstack.frames[state->fstack.length - 1];
 }
@@ -41,14 +43,14 @@ static inline void fstack_pop(void)
 }
 
 /******************************************************************************
- * Compute/Eval                                                               *
+ * Tree walker: Compute/Eval                                                  *
  ******************************************************************************/
 
 /** eval function: the basic object-by-object evaluation model.
  * This is called by `compute` (which see) on each member of a closure.
  * eval pushes onto the call frame stack only when a closure is called.
  */
-static inline void eval(clos_t *frame)
+static inline void eval(frame_t *frame)
 {
   auto cmd    = DIRECT_CAR(frame->body);
   frame->body = DIRECT_CDR(frame->body);
@@ -74,11 +76,17 @@ static inline void eval(clos_t *frame)
       if (frame->body)
         // There is still work to be done in the current frame, establish a new
         // call frame for this closure.
-        fstack_push(new_clos->body, new_clos->env);
+        fstack_push((frame_t){.body   = new_clos->body,
+                              .source = new_clos->body,
+                              .env    = new_clos->env});
       else
+      {
         // If the current frames work is already complete, we can store this new
         // closure onto it.  This is essentially a `tail call`.
-        *frame = *new_clos;
+        frame->body   = new_clos->body;
+        frame->source = new_clos->body;
+        frame->env    = new_clos->env;
+      }
     }
     else if (IS_PRIM(val))
     {
@@ -99,24 +107,28 @@ static inline void eval(clos_t *frame)
   case TAG_NUM:
   case TAG_CLOS:
   case TAG_PRIM:
+  case TAG_CODE:
   default:
     push(cmd);
     break;
   }
 }
 
-/** Compute function: the main driver of Forsp.
+/** Tree walking compute: the original driver of Forsp.
 
  * This is the core loop for evaluation in Forsp.  We keep evaluating a `frame`,
  * member by member through `eval` (which see),
  */
-void compute(obj_t *comp, obj_t *env)
+static obj_t *tree_compute(obj_t *comp, obj_t *env)
 {
-  fstack_push(comp, env);
-  for (clos_t *frame = fstack_peek(); fstack_available(); frame = fstack_peek())
+  fstack_push((frame_t){.body = comp, .source = comp, .env = env});
+  for (frame_t *frame = fstack_peek(); fstack_available();
+       frame = fstack_peek())
   {
     if (!frame->body)
     {
+      if (state->fstack.length == 1)
+        env = frame->env;
       fstack_pop();
       continue;
     }
@@ -125,9 +137,14 @@ void compute(obj_t *comp, obj_t *env)
     printf("compute[%ld]: ", state->fstack.length);
     print(frame->body);
     printf("\n");
-    printf("stack: ");
-    print(state->stack);
-    printf("\n");
+    printf("stack: (");
+    for (u64 i = state->stack.length; i > 0; --i)
+    {
+      print(state->stack.items[i - 1]);
+      if (i > 1)
+        printf(" ");
+    }
+    printf(")\n");
     printf("env: ");
     print(frame->env);
     printf("\n");
@@ -136,6 +153,300 @@ void compute(obj_t *comp, obj_t *env)
 
     eval(frame);
   }
+  return env;
+}
+
+/******************************************************************************
+ * Virtual machine                                                            *
+ ******************************************************************************/
+
+/** Value of the binding `insn->offset` bindings into the frame's environment.
+ * Dynamic frames can't trust the offset, so we fall back to a lookup.
+
+ * The offset folds the depth of the binding's frame and its index there into
+ * one count, as frames are just stretches of the same association list.  So
+ * this is still linear in the offset, only cheaper per step than `env_find`.
+ */
+static inline obj_t *vm_local(frame_t *frame, const insn_t *insn)
+{
+  if (frame->dynamic)
+    return env_find(frame->env, insn->arg);
+
+  obj_t *env = frame->env;
+  for (u64 i = insn->offset; i > 0; --i)
+    env = DIRECT_CDR(env);
+  return DIRECT_CDR(DIRECT_CAR(env));
+}
+
+/** Call primitive `prim` for `frame`.
+ * If the primitive may change the environment behind the compiler's back (i.e.
+ * a `pop` it couldn't see), the frame becomes dynamic.  We can't compare the
+ * environment before and after, as a collection may move it.
+ */
+static inline void vm_prim(frame_t *frame, obj_t *prim)
+{
+  as_prim(prim)(&frame->env);
+  frame->dynamic |= as_prim(prim) == prim_pop;
+}
+
+// Taking the address of labels and `goto *` are extensions (GNU C, clang).
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+
+/// Handler addresses for each opcode, see `compute_thread`.
+static const void *const *vm_ops = NULL;
+
+#if DEBUG & DEBUG_COMPUTE
+static void vm_trace(const insn_t *pc)
+{
+  static const char *const names[NUM_OPCODES] = {
+      [OP_CONST]          = "const",
+      [OP_CLOSURE_LAZY]   = "closure-lazy",
+      [OP_CLOSURE]        = "closure",
+      [OP_CALL]           = "call",
+      [OP_TAILCALL]       = "tailcall",
+      [OP_CALL_LOCAL]     = "call-local",
+      [OP_TAILCALL_LOCAL] = "tailcall-local",
+      [OP_PRIM]           = "prim",
+      [OP_PUSH]           = "push",
+      [OP_PUSH_LOCAL]     = "push-local",
+      [OP_PUSH_PRIM]      = "push-prim",
+      [OP_DEFINE]         = "define",
+      [OP_RET]            = "ret",
+      [OP_NO_QUOTE]       = "no-quote",
+  };
+  for (u64 op = 0; op < NUM_OPCODES; ++op)
+  {
+    if (vm_ops[op] == pc->op)
+    {
+      printf("vm[%ld]: %s ", state->fstack.length, names[op]);
+      break;
+    }
+  }
+  print(pc->arg);
+  printf("\nstack: (");
+  for (u64 i = state->stack.length; i > 0; --i)
+  {
+    print(state->stack.items[i - 1]);
+    if (i > 1)
+      printf(" ");
+  }
+  printf(")\n");
+  BORDER();
+}
+#define VM_NEXT()      \
+  do                   \
+  {                    \
+    vm_trace(pc);      \
+    goto *pc->op;      \
+  } while (0)
+#else
+#define VM_NEXT() goto *pc->op
+#endif
+
+/** The virtual machine: a direct threaded interpreter over compiled code.
+
+ * Each instruction holds the address of its own handler, so dispatch is a
+ * single indirect jump.  Calling with `code = NULL` only sets up `vm_ops`.
+ */
+static obj_t *vm(code_t *code, obj_t *env)
+{
+  static const void *const ops[NUM_OPCODES] = {
+      [OP_CONST]          = &&op_const,
+      [OP_CLOSURE_LAZY]   = &&op_closure_lazy,
+      [OP_CLOSURE]        = &&op_closure,
+      [OP_CALL]           = &&op_call,
+      [OP_TAILCALL]       = &&op_tailcall,
+      [OP_CALL_LOCAL]     = &&op_call_local,
+      [OP_TAILCALL_LOCAL] = &&op_tailcall_local,
+      [OP_PRIM]           = &&op_prim,
+      [OP_PUSH]           = &&op_push,
+      [OP_PUSH_LOCAL]     = &&op_push_local,
+      [OP_PUSH_PRIM]      = &&op_push_prim,
+      [OP_DEFINE]         = &&op_define,
+      [OP_RET]            = &&op_ret,
+      [OP_NO_QUOTE]       = &&op_no_quote,
+  };
+  if (!code)
+  {
+    vm_ops = ops;
+    return NULL;
+  }
+
+  u64 base = state->fstack.length;
+  frame_t *frame =
+      fstack_push((frame_t){.source = make_code(code), .env = env});
+  const insn_t *pc = code->insns;
+  obj_t *val       = NULL;
+  VM_NEXT();
+
+op_const:
+  push(pc->arg);
+  ++pc;
+  VM_NEXT();
+
+op_closure_lazy:
+{
+  // Compile the body on first construction, then never come back here.
+  insn_t *insn = (insn_t *)pc;
+  code_ensure(as_code(insn->arg));
+  insn->op = &&op_closure;
+}
+  goto op_closure;
+
+op_closure:
+  if (frame->dynamic)
+    push(make_clos(make_code(code_ensure(code_twin(as_code(pc->arg)))),
+                   frame->env));
+  else
+    push(make_clos(pc->arg, frame->env));
+  ++pc;
+  VM_NEXT();
+
+op_call:
+  val = env_find(frame->env, pc->arg);
+  goto call;
+
+op_call_local:
+  val = vm_local(frame, pc);
+  goto call;
+
+op_tailcall:
+  val = env_find(frame->env, pc->arg);
+  goto tailcall;
+
+op_tailcall_local:
+  val = vm_local(frame, pc);
+  goto tailcall;
+
+op_prim:
+  if (frame->dynamic)
+  {
+    val = env_find(frame->env, pc->arg);
+    goto call_maybe_tail;
+  }
+  vm_prim(frame, pc->value);
+  ++pc;
+  VM_NEXT();
+
+op_push:
+  if (frame->dynamic)
+    goto push_dynamic;
+  push(env_find(frame->env, pc->arg));
+  ++pc;
+  VM_NEXT();
+
+op_push_local:
+  if (frame->dynamic)
+    goto push_dynamic;
+  push(vm_local(frame, pc));
+  ++pc;
+  VM_NEXT();
+
+op_push_prim:
+  if (frame->dynamic)
+    goto push_dynamic;
+  push(pc->value);
+  ++pc;
+  VM_NEXT();
+
+op_define:
+  if (frame->dynamic)
+  {
+    // As with push_dynamic, `pop` itself may have been rebound.
+    push(pc->arg);
+    val = env_find(frame->env, state->atom_pop);
+    goto call_maybe_tail;
+  }
+  frame->env = env_define(frame->env, pc->arg, pop());
+  ++pc;
+  VM_NEXT();
+
+op_ret:
+  if (state->fstack.length == base + 1)
+  {
+    env = frame->env;
+    fstack_pop();
+    return env;
+  }
+  fstack_pop();
+  frame = fstack_peek();
+  pc    = frame->pc;
+  VM_NEXT();
+
+op_no_quote:
+  FAIL("Expected data following a quote form");
+
+push_dynamic:
+  // A fused `'x push` in a dynamic frame: do exactly what it says.
+  push(pc->arg);
+  val = env_find(frame->env, state->atom_push);
+  goto call_maybe_tail;
+
+call_maybe_tail:
+  if (pc[1].op == &&op_ret)
+    goto tailcall;
+  goto call;
+
+call:
+  ++pc;
+  if (IS_CLOS(val))
+  {
+    clos_t *clos = as_clos(val);
+    frame->pc    = pc;
+    frame        = fstack_push(
+        (frame_t){.source = clos->body, .env = clos->env});
+    pc           = as_code(clos->body)->insns;
+  }
+  else if (IS_PRIM(val))
+  {
+    vm_prim(frame, val);
+  }
+  else
+  {
+    push(val);
+  }
+  VM_NEXT();
+
+tailcall:
+  if (IS_CLOS(val))
+  {
+    // Nothing left to do in this frame, so reuse it for the closure.
+    clos_t *clos   = as_clos(val);
+    frame->source  = clos->body;
+    frame->env     = clos->env;
+    frame->dynamic = false;
+    pc             = as_code(clos->body)->insns;
+  }
+  else
+  {
+    ++pc;
+    if (IS_PRIM(val))
+      vm_prim(frame, val);
+    else
+      push(val);
+  }
+  VM_NEXT();
+}
+
+#pragma GCC diagnostic pop
+
+void compute_thread(code_t *code)
+{
+  if (!vm_ops)
+    vm(NULL, NULL);
+  for (u64 i = 0; i < code->length; ++i)
+    code->insns[i].op = vm_ops[(uintptr_t)code->insns[i].op];
+}
+
+obj_t *compute(obj_t *comp, obj_t *env)
+{
+  if (state->tree_walk)
+    return tree_compute(comp, env);
+  code_t *code = compile(comp, env);
+  env          = vm(code, env);
+  code_release(code);
+  return env;
 }
 
 /* Copyright (c) 2024 Anthony Bonkoski
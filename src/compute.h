@@ -11,7 +11,16 @@
 #include "common.h"
 #include "obj.h"
 
-void compute(obj_t *comp, obj_t *env);
+/** Evaluate `comp` as a closure body under `env`.
+ * Uses the virtual machine unless `state->tree_walk` is set.
+ * Returns the environment of `comp` once it's done, with everything it bound,
+ * unless it ended with a tail call.
+ */
+obj_t *compute(obj_t *comp, obj_t *env);
+
+/** Swap the opcodes in freshly compiled `code` for VM handler addresses.
+ */
+void compute_thread(code_t *code);
 
 #endif
 
@@ -0,0 +1,336 @@
+/* fasl.c: Images of programs, loaded without reading them again.
+ * Created: 2026-10-17
+ * Author: Aryadev Chavali
+ * License: See end of file
+ */
+
+#include "fasl.h"
+#include "gc.h"
+#include "state.h"
+
+#include <stdbit.h>
+#include <stdckdint.h>
+
+bool fasl_is_image(const void *image, u64 size)
+{
+  return size >= sizeof(fasl_header_t) &&
+         !memcmp(image, FASL_MAGIC, sizeof(((fasl_header_t *)0)->magic));
+}
+
+/******************************************************************************
+ * Writing                                                                    *
+ ******************************************************************************/
+
+/** Image being written.
+ * `atoms`: every atom written so far, in order of index.
+ * `table`: index + 1 of every atom written so far, 0 if empty, by address.
+ * `slots`: both fields of every pair written so far.
+ * `work`: pairs whose slot has yet to be filled in.
+ */
+typedef struct
+{
+  vec_t atoms;
+  struct
+  {
+    u64 capacity;
+    u64 *indices;
+  } table;
+  struct
+  {
+    u64 length, capacity;
+    u64 *fields;
+  } slots;
+  struct
+  {
+    u64 length, capacity;
+    struct fasl_work
+    {
+      obj_t *pair;
+      u64 slot;
+    } *items;
+  } work;
+} fasl_writer_t;
+
+static void *fasl_grow(void *items, u64 *capacity, u64 size)
+{
+  *capacity = MAX(64LU, *capacity * 2);
+  items     = realloc(items, *capacity * size);
+  if (!items)
+    FAIL("Failed to allocate an image");
+  return items;
+}
+
+/// Slot of `atom` in a table of `capacity` slots, a power of 2.
+static inline u64 fasl_hash(obj_t *atom, u64 capacity)
+{
+  u64 hash = (uintptr_t)atom * 0x9E3779B97F4A7C15;
+  return hash >> (64 - stdc_trailing_zeros(capacity));
+}
+
+/// Index of `atom` in the image, adding it if it isn't there yet.
+static u64 fasl_atom(fasl_writer_t *writer, obj_t *atom)
+{
+  auto table = &writer->table;
+  // Kept at most half full.
+  if (writer->atoms.length * 2 >= table->capacity)
+  {
+    u64 capacity = MAX(64LU, table->capacity * 2);
+    free(table->indices);
+    table->capacity = capacity;
+    table->indices  = calloc(capacity, sizeof(*table->indices));
+    if (!table->indices)
+      FAIL("Failed to allocate an image");
+    for (u64 i = 0; i < writer->atoms.length; ++i)
+    {
+      u64 slot = fasl_hash(writer->atoms.items[i], capacity);
+      while (table->indices[slot])
+        slot = (slot + 1) & (capacity - 1);
+      table->indices[slot] = i + 1;
+    }
+  }
+
+  u64 slot = fasl_hash(atom, table->capacity);
+  for (; table->indices[slot]; slot = (slot + 1) & (table->capacity - 1))
+    if (writer->atoms.items[table->indices[slot] - 1] == atom)
+      return table->indices[slot] - 1;
+  vec_push(&writer->atoms, atom);
+  table->indices[slot] = writer->atoms.length;
+  return writer->atoms.length - 1;
+}
+
+/// Index of a new slot in the image, both of its fields NIL.
+static u64 fasl_slot(fasl_writer_t *writer)
+{
+  auto slots = &writer->slots;
+  if (slots->length + 2 > slots->capacity)
+    slots->fields = fasl_grow(slots->fields, &slots->capacity, sizeof(u64));
+  slots->fields[slots->length++] = 0;
+  slots->fields[slots->length++] = 0;
+  return slots->length / 2 - 1;
+}
+
+/** Encode `obj` as a field of the image.  A pair is given a slot, filled in
+ * once it's taken off `writer->work`.
+ */
+static u64 fasl_encode(fasl_writer_t *writer, obj_t *obj)
+{
+  switch (GET_TAG(obj))
+  {
+  case TAG_NIL:
+  case TAG_NUM:
+    return (u64)obj;
+  case TAG_ATOM:
+    return fasl_atom(writer, obj) << 8 | TAG_ATOM;
+  case TAG_PAIR:
+  {
+    auto work = &writer->work;
+    if (work->length == work->capacity)
+      work->items =
+          fasl_grow(work->items, &work->capacity, sizeof(*work->items));
+    u64 slot = fasl_slot(writer);
+    work->items[work->length++] =
+        (struct fasl_work){.pair = obj, .slot = slot};
+    return slot << 8 | TAG_PAIR;
+  }
+  default:
+    FAIL("Only what's read can be written to an image");
+  }
+}
+
+/** Encode `obj` and everything it refers to.  What's read is a tree, so every
+ * pair in it is only written once.
+ */
+static u64 fasl_encode_all(fasl_writer_t *writer, obj_t *obj)
+{
+  u64 encoded = fasl_encode(writer, obj);
+  auto work   = &writer->work;
+  while (work->length)
+  {
+    struct fasl_work item = work->items[--work->length];
+    // The rest of a list is given the next slot, so lists are laid out in
+    // order.
+    u64 second = fasl_encode(writer, DIRECT_CDR(item.pair));
+    u64 first  = fasl_encode(writer, DIRECT_CAR(item.pair));
+    writer->slots.fields[2 * item.slot]     = first;
+    writer->slots.fields[2 * item.slot + 1] = second;
+  }
+  return encoded;
+}
+
+void fasl_write(FILE *fp)
+{
+  fasl_writer_t writer = {0};
+  vec_init(&writer.atoms, 64);
+
+  // Each object is added to the list of forms as it's read, and is never
+  // looked at again.
+  u64 forms = 0, last = 0;
+  obj_t *obj;
+  while (read_next(&obj))
+  {
+    u64 form = fasl_slot(&writer);
+    if (!forms)
+      forms = form << 8 | TAG_PAIR;
+    else
+      writer.slots.fields[2 * last + 1] = form << 8 | TAG_PAIR;
+    last        = form;
+    u64 encoded = fasl_encode_all(&writer, obj);
+    writer.slots.fields[2 * form] = encoded;
+  }
+
+  fasl_header_t header = {.atoms = writer.atoms.length,
+                          .slots = writer.slots.length / 2,
+                          .forms = forms};
+  memcpy(header.magic, FASL_MAGIC, sizeof(header.magic));
+  for (u64 i = 0; i < writer.atoms.length; ++i)
+    header.chars += atom_length(writer.atoms.items[i]);
+  u64 padding = -header.chars % sizeof(u64);
+  header.chars += padding;
+
+  fwrite(&header, sizeof(header), 1, fp);
+  for (u64 i = 0; i < writer.atoms.length; ++i)
+  {
+    u64 length = atom_length(writer.atoms.items[i]);
+    fwrite(&length, sizeof(length), 1, fp);
+  }
+  for (u64 i = 0; i < writer.atoms.length; ++i)
+    fwrite(as_atom(writer.atoms.items[i]), 1,
+           atom_length(writer.atoms.items[i]), fp);
+  fwrite(&(u64){0}, 1, padding, fp);
+  fwrite(writer.slots.fields, sizeof(u64), writer.slots.length, fp);
+  if (ferror(fp))
+    FAIL("Failed to write an image");
+
+  vec_stop(&writer.atoms);
+  free(writer.table.indices);
+  free(writer.slots.fields);
+  free(writer.work.items);
+}
+
+/******************************************************************************
+ * Loading                                                                    *
+ ******************************************************************************/
+
+/** Image being loaded.
+ * `atoms`: every atom of the image, interned.
+ * `chunks`: chunks the slots of the image are copied into, see
+ * `gc_alloc_chunks`.
+ */
+typedef struct
+{
+  const char *name;
+  u64 atoms_length, slots_length;
+  obj_t **atoms;
+  gc_chunk_t **chunks;
+} fasl_loader_t;
+
+#define FASL_CORRUPT(LOADER) \
+  FAIL("%s: Image is corrupt or truncated", (LOADER)->name)
+
+static inline obj_t **fasl_fields(const fasl_loader_t *loader, u64 slot)
+{
+  gc_chunk_t *c = loader->chunks[slot / GC_CHUNK_USABLE_SLOTS];
+  return (obj_t **)(c->data + (GC_CHUNK_FIRST_SLOT +
+                               slot % GC_CHUNK_USABLE_SLOTS) * GC_SLOT_SIZE);
+}
+
+/** Object `field` of the image refers to, where it's been loaded.  It may
+ * only refer to slots from `first` on.
+ */
+static inline obj_t *fasl_relocate(const fasl_loader_t *loader, u64 field,
+                                   u64 first)
+{
+  u64 index = field >> 8;
+  switch (field & 0xFF)
+  {
+  case TAG_NIL:
+    if (field)
+      FASL_CORRUPT(loader);
+    return NULL;
+  case TAG_NUM:
+    return (obj_t *)field;
+  case TAG_ATOM:
+    if (index >= loader->atoms_length)
+      FASL_CORRUPT(loader);
+    return loader->atoms[index];
+  case TAG_PAIR:
+    if (index < first || index >= loader->slots_length)
+      FASL_CORRUPT(loader);
+    return TAG_TYPE(fasl_fields(loader, index), PAIR);
+  default:
+    FASL_CORRUPT(loader);
+  }
+}
+
+void fasl_load(const char *name, const void *image, u64 size)
+{
+  if (!fasl_is_image(image, size))
+    FAIL("%s: Not an image", name);
+  const fasl_header_t *header = image;
+  fasl_loader_t loader        = {.name         = name,
+                                 .atoms_length = header->atoms,
+                                 .slots_length = header->slots};
+
+  // Every count is checked against the size before anything is touched.
+  u64 expected = sizeof(*header), words;
+  if (ckd_mul(&words, header->slots, 2) ||
+      ckd_add(&words, words, header->atoms) ||
+      ckd_mul(&words, words, sizeof(u64)) ||
+      ckd_add(&expected, expected, words) ||
+      ckd_add(&expected, expected, header->chars) || expected != size ||
+      header->chars % sizeof(u64))
+    FASL_CORRUPT(&loader);
+  const u64 *lengths = (const u64 *)(header + 1);
+  const char *chars  = (const char *)(lengths + header->atoms);
+  const u64 *slots   = (const u64 *)(chars + header->chars);
+
+  loader.atoms = malloc(header->atoms * sizeof(*loader.atoms));
+  if (header->atoms && !loader.atoms)
+    FAIL("Failed to allocate atoms of image '%s'", name);
+  for (u64 i = 0, offset = 0; i < header->atoms; offset += lengths[i++])
+  {
+    if (lengths[i] > header->chars - offset)
+      FASL_CORRUPT(&loader);
+    loader.atoms[i] = intern(chars + offset, lengths[i]);
+  }
+
+  u64 chunks =
+      (header->slots + GC_CHUNK_USABLE_SLOTS - 1) / GC_CHUNK_USABLE_SLOTS;
+  loader.chunks = malloc(chunks * sizeof(*loader.chunks));
+  if (chunks && !loader.chunks)
+    FAIL("Failed to allocate chunks of image '%s'", name);
+  gc_alloc_chunks(header->slots, loader.chunks);
+  for (u64 i = 0; i < header->slots;)
+  {
+    // Slots are copied a chunk at a time, so only references are looked up.
+    obj_t **fields = fasl_fields(&loader, i);
+    u64 end        = MIN(header->slots, i + GC_CHUNK_USABLE_SLOTS);
+    for (; i < end; ++i, fields += GC_SLOT_SIZE / sizeof(*fields))
+    {
+      fields[0] = fasl_relocate(&loader, slots[2 * i], i + 1);
+      fields[1] = fasl_relocate(&loader, slots[2 * i + 1], i + 1);
+      // Nothing read is an improper list.
+      if (!IS_NIL(fields[1]) && !IS_PAIR(fields[1]))
+        FASL_CORRUPT(&loader);
+    }
+  }
+
+  read_input(name, NULL, 0);
+  state->reader->forms = fasl_relocate(&loader, header->forms, 0);
+  if (!IS_NIL(state->reader->forms) && !IS_PAIR(state->reader->forms))
+    FASL_CORRUPT(&loader);
+  free(loader.atoms);
+  free(loader.chunks);
+}
+
+/* Copyright (C) 2026 Aryadev Chavali
+
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the MIT License for details.
+
+ * You may distribute and modify this code under the terms of the MIT License,
+ * which you should have received a copy of along with this program.  If not,
+ * please go to <https://opensource.org/license/MIT>.
+
+ */
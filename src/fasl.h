@@ -0,0 +1,65 @@
+/* fasl.h: Images of programs, loaded without reading them again.
+ * Created: 2026-10-17
+ * Author: Aryadev Chavali
+ * License: See end of file
+ *
+ * An image holds every object at the top level of some input, as `read` would
+ * give them, so running it skips lexing and interning altogether.  Loading
+ * maps the image, interns each of its atoms once, then copies its slots into
+ * new chunks of the old generation, relocating references as it goes.
+ *
+ * Compiled code isn't held: it's resolved against the environment it's
+ * compiled under, and refers to VM handlers by address.
+ */
+
+#ifndef FASL_H
+#define FASL_H
+
+#include "common.h"
+#include "obj.h"
+
+/** An image is a header followed by its records in the order of its counts,
+ * every field a native u64:
+ * - `atoms`: the length of every atom.
+ * - `chars`: the names of every atom, back to back, padded to a multiple of 8.
+ * - `slots`: both fields of every pair.
+ * Fields are objects encoded as in the heap, except that atoms and pairs hold
+ * their index among `atoms` or `slots` rather than an address.  A pair only
+ * refers to pairs after it, and its second field is always a list, so an image
+ * holds nothing `read` couldn't give.  `forms` is a
+ * list (so encoded likewise) of every object at the top level, in order.
+ */
+#define FASL_MAGIC "FORSPFL1"
+typedef struct
+{
+  char magic[8];
+  u64 atoms, chars, slots;
+  u64 forms;
+} fasl_header_t;
+
+/// Whether the `size` bytes at `image` look like an image.
+bool fasl_is_image(const void *image, u64 size);
+
+/** Read every object left in the input, then write an image of them to `fp`.
+ */
+void fasl_write(FILE *fp);
+
+/** Read from the objects of the `size` bytes of image at `image` from now on,
+ * `name` being where they came from.  Nothing refers back to `image` once
+ * this returns.
+ */
+void fasl_load(const char *name, const void *image, u64 size);
+
+#endif
+
+/* Copyright (C) 2026 Aryadev Chavali
+
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the MIT License for details.
+
+ * You may distribute and modify this code under the terms of the MIT License,
+ * which you should have received a copy of along with this program.  If not,
+ * please go to <https://opensource.org/license/MIT>.
+
+ */
@@ -1,13 +1,24 @@
-/* gc.c: Pool-based mark-sweep garbage collector for pairs and closures.
+/* gc.c: Generational garbage collector for pairs and closures.
  * Created: 2026-06-21
  * Author: Aryadev Chavali
  * License: See end of file
  */
 
 #include "gc.h"
+#include "compile.h"
 #include "state.h"
 
+#include <sched.h>
+#include <signal.h>
+#include <stdarg.h>
 #include <stdbit.h>
+#include <sys/mman.h>
+#include <time.h>
+
+#if GC_SWEEP_SIMD && defined(__x86_64__)
+#define GC_SWEEP_X86 1
+#include <immintrin.h>
+#endif
 
 static gc_t *gc = &state->gc;
 
@@ -20,58 +31,349 @@ static inline void bitmap_set(u64 *bits, size_t idx)
   bits[idx / 64] |= (1ULL << (idx % 64));
 }
 
+static inline void bitmap_clear(u64 *bits, size_t idx)
+{
+  bits[idx / 64] &= ~(1ULL << (idx % 64));
+}
+
 static inline bool bitmap_test(const u64 *bits, size_t idx)
 {
   return (bits[idx / 64] >> (idx % 64)) & 1;
 }
 
+/** Set bit `idx`, atomically.  Returns whether we were the ones to set it.
+ */
+static inline bool bitmap_test_and_set(u64 *bits, size_t idx)
+{
+  u64 bit = 1ULL << (idx % 64);
+  // Most tests during a mark find the bit already set, so avoid the write.
+  if (__atomic_load_n(&bits[idx / 64], __ATOMIC_RELAXED) & bit)
+    return false;
+  return !(__atomic_fetch_or(&bits[idx / 64], bit, __ATOMIC_RELAXED) & bit);
+}
+
+/******************************************************************************
+ * Pause timing                                                               *
+ ******************************************************************************/
+
+static u64 gc_clock(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LU + ts.tv_nsec;
+}
+
+/** Record a pause in `pauses` which started at `start` (see `gc_clock`).
+ */
+static void gc_pause(gc_pauses_t *pauses, u64 start)
+{
+  u64 pause = gc_clock() - start;
+  ++pauses->count;
+  pauses->total += pause;
+  pauses->max = MAX(pauses->max, pause);
+}
+
+/** Bucket of a histogram (see `gc_histogram_t`) which `ns` falls in.
+ */
+static inline u64 gc_histogram_bucket(u64 ns)
+{
+  constexpr u64 subs = 1 << GC_HISTOGRAM_SUB_BITS;
+  if (ns < subs)
+    return ns;
+  u64 log2 = 63 - stdc_leading_zeros(ns);
+  return ((log2 - GC_HISTOGRAM_SUB_BITS + 1) << GC_HISTOGRAM_SUB_BITS) +
+         ((ns >> (log2 - GC_HISTOGRAM_SUB_BITS)) & (subs - 1));
+}
+
+/** Least pause which falls in `bucket`.
+ */
+static inline u64 gc_histogram_floor(u64 bucket)
+{
+  constexpr u64 subs = 1 << GC_HISTOGRAM_SUB_BITS;
+  if (bucket < subs)
+    return bucket;
+  u64 log2 = (bucket >> GC_HISTOGRAM_SUB_BITS) + GC_HISTOGRAM_SUB_BITS - 1;
+  return (subs + (bucket & (subs - 1))) << (log2 - GC_HISTOGRAM_SUB_BITS);
+}
+
+/** Upper bound of the pause at `percentile` (out of 100) in `histogram`.
+ */
+static u64 gc_histogram_percentile(const gc_histogram_t *histogram,
+                                   u64 percentile)
+{
+  u64 rank = histogram->count * percentile / 100;
+  u64 seen = 0;
+  for (u64 i = 0; i < GC_HISTOGRAM_BUCKETS - 1; ++i)
+  {
+    seen += histogram->buckets[i];
+    if (seen > rank)
+      return gc_histogram_floor(i + 1) - 1;
+  }
+  return UINT64_MAX;
+}
+
+/** Log a pause of the mutator which started at `start`.
+ */
+static void gc_pause_log(u64 start)
+{
+  gc_histogram_t *histogram = &gc->metadata.pause_histogram;
+  u64 pause                 = gc_clock() - start;
+  ++histogram->count;
+  ++histogram->buckets[gc_histogram_bucket(pause)];
+  histogram->max = MAX(histogram->max, pause);
+}
+
+static bool gc_sweep_step(size_t *freed);
+static void gc_stats_poll(void);
+static void gc_snapshot_poll(void);
+static void gc_shade(obj_t *obj);
+static void gc_mark_start(void);
+static void gc_mark_increment(void);
+static void gc_profile_sample(const char *site);
+static void gc_profile_retain(void *(*survivor)(void *raw));
+static void *gc_profile_promoted(void *raw);
+static void *gc_profile_marked(void *raw);
+static void *gc_profile_copied(void *raw);
+
+/** Start allocating the old generation from its first chunk again.
+ */
+static inline void gc_cursor_reset(void)
+{
+  gc->cursor = (gc_cursor_t){.word = GC_CHUNK_MARK_WORDS};
+}
+
+/******************************************************************************
+ * Roots                                                                      *
+ ******************************************************************************/
+
+void gc_root(obj_t **slot)
+{
+  if (gc->roots.length == gc->roots.capacity)
+  {
+    gc->roots.capacity = MAX(GC_ROOTS_DEFAULT_CAPACITY, gc->roots.capacity * 2);
+    gc->roots.slots =
+        realloc(gc->roots.slots, sizeof(*gc->roots.slots) * gc->roots.capacity);
+    if (!gc->roots.slots)
+    {
+      FAIL("GC: failed to reallocate root stack");
+    }
+  }
+  gc->roots.slots[gc->roots.length++] = slot;
+}
+
+void gc_unroot(size_t n)
+{
+  assert(n <= gc->roots.length);
+  gc->roots.length -= n;
+}
+
 /******************************************************************************
- * Free list Helpers                                                          *
+ * Chunk region                                                               *
  ******************************************************************************/
 
-/** Push a new slot onto the free list.
- * This slot is presumed to be unused, thus the data owned by it is mutated to
- * become a `gc_free_slot_t`.
- * `chunk_id` and `slot_id` are stored in this type for allocation purposes.
+static void gc_pool_push(gc_pool_t *pool, gc_chunk_t *c)
+{
+  if (pool->capacity - pool->length == 0)
+  {
+    pool->capacity = MAX(1, pool->capacity * 2);
+    pool->chunks =
+        realloc(pool->chunks, sizeof(*pool->chunks) * pool->capacity);
+    if (!pool->chunks)
+    {
+      FAIL("GC: failed to reallocate pool of chunks");
+    }
+  }
+  pool->chunks[pool->length++] = c;
+}
+
+/** Reserve the region, as large as the OS lets us up to GC_REGION_SIZE.  None
+ * of it is backed by memory until it's touched.
+ */
+static void gc_region_reserve(void)
+{
+  constexpr u64 align = MAX(GC_CHUNK_SIZE, GC_HUGEPAGE_SIZE);
+  for (u64 size = GC_REGION_SIZE; size >= GC_CHUNK_SIZE; size /= 2)
+  {
+    // Map more than we need, then trim either side to align it.
+    u8 *raw = mmap(NULL, size + align, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (raw == MAP_FAILED)
+      continue;
+    u8 *start = (u8 *)(((uintptr_t)raw + align - 1) & ~(uintptr_t)(align - 1));
+    if (start > raw)
+      munmap(raw, start - raw);
+    munmap(start + size, raw + align - start);
+
+#ifdef GC_HUGEPAGES
+    madvise(start, size, MADV_HUGEPAGE);
+#endif
+    gc->region.start = start;
+    gc->region.end   = start + size;
+    gc->region.next  = start;
+    return;
+  }
+  FAIL("GC: failed to reserve memory for chunks");
+}
+
+/** Carve a zeroed chunk out of the region, reusing a released one if we can.
+ * Returns NULL once the region is used up.
  */
-static inline void gc_free_list_push(void *slot, u32 chunk_id, u32 slot_id)
+static gc_chunk_t *gc_chunk_map(void)
 {
-  gc_free_slot_t *fslot = slot;
-  fslot->next_slot      = gc->free_list;
-  fslot->chunk_id       = chunk_id;
-  fslot->slot_id        = slot_id;
-  gc->free_list         = slot;
+  gc_region_t *region = &gc->region;
+  if (region->released.length)
+    return region->released.chunks[--region->released.length];
+  else if (!region->start)
+    gc_region_reserve();
+
+  if (region->next == region->end)
+    return NULL;
+  gc_chunk_t *c = (gc_chunk_t *)region->next;
+  region->next += GC_CHUNK_SIZE;
+  return c;
 }
 
-/** Pop a free slot from the free list.
+/** Give the memory behind `c` back to the OS.  It reads as zero once touched
+ * again, so it may be handed out by `gc_chunk_map` as is.
  */
-static inline gc_free_slot_t *gc_free_list_pop()
+static void gc_chunk_release(gc_chunk_t *c)
+{
+  madvise(c, GC_CHUNK_SIZE, MADV_DONTNEED);
+  gc_pool_push(&gc->region.released, c);
+}
+
+static inline bool gc_is_old(const void *raw)
 {
-  gc_free_slot_t *free_slot = gc->free_list;
-  if (free_slot)
-    gc->free_list = free_slot->next_slot;
-  return free_slot;
+  return (const u8 *)raw >= gc->region.start &&
+         (const u8 *)raw < gc->region.next;
 }
 
 /******************************************************************************
- * Slot/Chunk interaction helpers                                             *
+ * Heap growth                                                                *
  ******************************************************************************/
 
-/** Check if `raw_ptr` is an allocation from `chunk`.
+/// Yield of a collection under which it's thought to have been wasted.
+#define GC_YIELD_LOW (0.25)
+
+static size_t gc_policy_fixed(size_t live, size_t)
+{
+  return live * GC_MULTIPLIER_DEFAULT;
+}
+
+/** Grow the multiplier when major collections free less than GC_YIELD_LOW of
+ * what was live, or take up more than the target fraction of the time since
+ * the last one (in proportion, up to double).  Halve it when they take up less
+ * than half the target, so a spike in the heap isn't held on to for long.
+ */
+static size_t gc_policy_adaptive(size_t live, size_t dead)
+{
+  gc_growth_t *growth = &gc->growth;
+  u64 now             = gc_clock();
+  u64 paused          = gc->metadata.pauses_mark.total +
+               gc->metadata.pauses_sweep.total +
+               gc->metadata.pauses_compact.total;
+  f64 fraction =
+      (f64)(paused - growth->paused) / MAX(1LU, now - growth->since);
+  f64 yield        = (f64)dead / MAX(1LU, live + dead);
+  growth->since    = now;
+  growth->paused   = paused;
+
+  if (yield < GC_YIELD_LOW)
+    growth->multiplier *= 2;
+  else if (fraction > growth->target)
+    growth->multiplier *= MIN(2.0, fraction / growth->target);
+  else if (fraction < growth->target / 2)
+    growth->multiplier /= 2;
+  growth->multiplier =
+      MIN(GC_MULTIPLIER_MAX, MAX(GC_MULTIPLIER_MIN, growth->multiplier));
+
+#if DEBUG & DEBUG_GC
+  printf("GC:adaptive: %.1f%% of time collecting, %.1f%% yield, %.2fx.\n",
+         fraction * 100, yield * 100, growth->multiplier);
+#endif
+  return live * growth->multiplier;
+}
+
+/// Available policies, the first being the default.
+static const gc_policy_t gc_policies[] = {
+    {"adaptive", gc_policy_adaptive},
+    {"fixed", gc_policy_fixed},
+};
+
+/** Threshold for the next major collection, given what the last found.
  */
-static inline bool gc_ptr_in_chunk(gc_chunk_t *chunk, void *raw_ptr)
+static size_t gc_grow(size_t live, size_t dead)
 {
-  auto start = chunk->data;
-  auto end   = start + GC_CHUNK_DATA_SIZE;
-  return (u8 *)raw_ptr >= start && (u8 *)raw_ptr < end;
+  size_t threshold = MAX(gc->growth.initial,
+                         gc->growth.policy->threshold(live, dead));
+  if (gc->growth.max)
+    threshold =
+        MAX(live + GC_NURSERY_SLOTS, MIN(gc->growth.max, threshold));
+  return threshold;
 }
 
-/** Get the slot that `raw_ptr` belongs to within `chunk`, presuming `raw_ptr`
- * has been verified to have been allocated within `chunk`.
+/** Size in slots of the environment variable `name`, in bytes with an
+ * optional K, M or G suffix.  Returns `fallback` if it isn't set.
  */
-static inline size_t gc_ptr_slot_in_chunk(gc_chunk_t *chunk, void *raw_ptr)
+static size_t gc_env_size(const char *name, size_t fallback)
+{
+  const char *value = getenv(name);
+  if (!value)
+    return fallback;
+
+  char *end  = NULL;
+  u64 bytes  = strtoull(value, &end, 10);
+  u64 shifts = 0;
+  switch (*end)
+  {
+  case 'G':
+    shifts += 10;
+    [[fallthrough]];
+  case 'M':
+    shifts += 10;
+    [[fallthrough]];
+  case 'K':
+    shifts += 10;
+    ++end;
+    break;
+  default:
+    break;
+  }
+  if (end == value || *end)
+    FAIL("GC: %s should be a size in bytes, not '%s'", name, value);
+  return (bytes << shifts) / GC_SLOT_SIZE;
+}
+
+void gc_growth_from_env(void)
 {
-  return ((u8 *)raw_ptr - chunk->data) / sizeof(gc_free_slot_t);
+  gc_growth_t *growth = &gc->growth;
+  const char *policy  = getenv("FORSP_GC_POLICY");
+  if (policy)
+  {
+    growth->policy = NULL;
+    for (u64 i = 0; i < ARRSIZE(gc_policies); ++i)
+      if (!strcmp(policy, gc_policies[i].name))
+        growth->policy = &gc_policies[i];
+    if (!growth->policy)
+      FAIL("GC: FORSP_GC_POLICY should be adaptive or fixed, not '%s'",
+           policy);
+  }
+
+  growth->initial = gc_env_size("FORSP_GC_INITIAL_HEAP", growth->initial);
+  growth->max     = gc_env_size("FORSP_GC_MAX_HEAP", growth->max);
+  if (!gc->metadata.num_collections)
+    gc->metadata.threshold = growth->initial;
+
+  const char *target = getenv("FORSP_GC_TARGET");
+  if (target)
+  {
+    char *end      = NULL;
+    growth->target = strtod(target, &end);
+    if (end == target || *end || !(growth->target > 0 && growth->target < 1))
+      FAIL("GC: FORSP_GC_TARGET should be a fraction between 0 and 1, not "
+           "'%s'",
+           target);
+  }
 }
 
 /******************************************************************************
@@ -82,15 +384,32 @@ void gc_init()
 {
   memset(&state->gc, 0, sizeof(state->gc));
   gc->metadata.threshold = GC_THRESHOLD_DEFAULT;
+  gc->compact            = GC_COMPACT_DEFAULT;
+  gc->prefetch           = GC_MARK_PREFETCH;
+  gc->growth             = (gc_growth_t){
+                  .policy     = &gc_policies[0],
+                  .initial    = GC_THRESHOLD_DEFAULT,
+                  .target     = GC_TARGET_DEFAULT,
+                  .multiplier = GC_MULTIPLIER_DEFAULT,
+                  .since      = gc_clock(),
+  };
+  gc_sweep_kernel(NULL);
+  gc_cursor_reset();
 }
 
 void gc_stop()
 {
-  for (size_t i = 0; i < gc->pool.length; ++i)
-  {
-    free(gc->pool.chunks[i]);
-  }
+  gc_mark_threads(1);
+  gc_profile(NULL, 0);
+  if (gc->region.start)
+    munmap(gc->region.start, gc->region.end - gc->region.start);
+  free(gc->region.released.chunks);
   free(gc->pool.chunks);
+  free(gc->roots.slots);
+  free(gc->nursery.start);
+  vec_stop(&gc->nursery.remembered);
+  vec_stop(&gc->nursery.promoted);
+  vec_stop(&gc->incremental.grey);
   memset(&state->gc, 0, sizeof(state->gc));
 }
 
@@ -104,99 +423,330 @@ void gc_reset()
  */
 static inline gc_chunk_t *gc_new_chunk(void)
 {
-  gc_chunk_t *c = aligned_alloc(16, sizeof(gc_chunk_t));
+  static_assert(sizeof(gc_chunk_t) == GC_CHUNK_SIZE);
+  // Chunks come zeroed, so the bitmaps are already clear.
+  gc_chunk_t *c = gc_chunk_map();
   if (!c)
   {
-    FAIL("GC: failed to allocate chunk");
+    FAIL("GC: out of memory reserved for chunks, see GC_REGION_SIZE");
   }
-  memset(c->mark_bits, 0, sizeof(c->mark_bits));
-  memset(c->live_bits, 0, sizeof(c->live_bits));
+  gc_pool_push(&gc->pool, c);
+  gc->metadata.chunks_peak = MAX(gc->metadata.chunks_peak, gc->pool.length);
+  return c;
+}
 
-  // Chain all new slots into the free list
-  for (size_t i = 0; i < GC_CHUNK_SLOTS; ++i)
-  {
-    void *slot = c->data + i * 16;
-    gc_free_list_push(slot, gc->pool.length, i);
-  }
+static inline bool gc_threshold_met(void)
+{
+  return gc->metadata.slots_live >= gc->metadata.threshold;
+}
 
-  // Push onto the chunk array in the pool.
-  if (!gc->pool.capacity)
+/** Bits of word `w` of a chunk's bitmaps which cover allocatable slots.
+ */
+static inline u64 gc_word_usable(u64 w)
+{
+  if (w * 64 >= GC_CHUNK_FIRST_SLOT)
+    return ~0ULL;
+  else if ((w + 1) * 64 <= GC_CHUNK_FIRST_SLOT)
+    return 0;
+  return ~0ULL << (GC_CHUNK_FIRST_SLOT - w * 64);
+}
+
+/** Move the cursor on to the next word with free slots, moving on to the next
+ * chunk (sweeping it, or making a new one) when this one is full.
+ */
+static void gc_cursor_advance(void)
+{
+  gc_cursor_t *cur = &gc->cursor;
+  while (!cur->free)
   {
-    gc->pool.capacity = 1;
-    gc->pool.chunks   = malloc(sizeof(*gc->pool.chunks));
+    if (++cur->word >= GC_CHUNK_MARK_WORDS)
+    {
+      if (cur->next_chunk == gc->pool.length)
+      {
+#if DEBUG & DEBUG_GC
+        printf("GC:alloc: New chunk - old generation is full\n");
+#endif
+        gc_new_chunk();
+      }
+
+      // Slots which died since the last mark only become free once swept.
+      for (size_t freed = 0;
+           gc->sweeper.next <= cur->next_chunk && gc_sweep_step(&freed);)
+        continue;
+
+      cur->chunk = gc->pool.chunks[cur->next_chunk++];
+      cur->word  = GC_CHUNK_FIRST_SLOT / 64;
+    }
+    cur->free = ~cur->chunk->live_bits[cur->word] & gc_word_usable(cur->word);
   }
-  else if (gc->pool.capacity - gc->pool.length == 0)
+}
+
+/** Allocate a slot in the old generation, initialised to `first` and
+ * `second`.  This never collects.
+ */
+static inline obj_t **gc_alloc_old(obj_t *first, obj_t *second)
+{
+  gc_cursor_t *cur = &gc->cursor;
+  if (!cur->free)
+    gc_cursor_advance();
+
+  // Take the lowest free slot through a single hardware inst.
+  int bit = stdc_trailing_zeros_ull(cur->free);
+  cur->free &= cur->free - 1;
+  cur->chunk->live_bits[cur->word] |= 1ULL << bit;
+  gc->metadata.slots_live++;
+
+  obj_t **fields =
+      (obj_t **)(cur->chunk->data + (cur->word * 64 + bit) * GC_SLOT_SIZE);
+  fields[0] = first;
+  fields[1] = second;
+  return fields;
+}
+
+/******************************************************************************
+ * Nursery                                                                    *
+ ******************************************************************************/
+
+static inline bool gc_is_young(const void *raw)
+{
+  return (const u8 *)raw >= gc->nursery.start &&
+         (const u8 *)raw < gc->nursery.end;
+}
+
+/// Number of slots allocated by the program so far.
+static inline u64 gc_allocated(void)
+{
+  return gc->metadata.slots_allocated +
+         (gc->nursery.top - gc->nursery.start) / GC_SLOT_SIZE;
+}
+
+static void gc_nursery_init(void)
+{
+  gc->nursery.start = aligned_alloc(GC_SLOT_SIZE, GC_NURSERY_SIZE);
+  if (!gc->nursery.start)
   {
-    gc->pool.capacity *= 2;
-    gc->pool.chunks =
-        realloc(gc->pool.chunks, sizeof(*gc->pool.chunks) * gc->pool.capacity);
+    FAIL("GC: failed to allocate nursery");
   }
+  gc->nursery.end   = gc->nursery.start + GC_NURSERY_SIZE;
+  gc->nursery.top   = gc->nursery.start;
+  gc->nursery.limit = gc->nursery.end;
+}
+
+/** Evacuate the object in `*slot` if it's young, updating `*slot` to its new
+ * address in the old generation.  Fields of the copy are evacuated later, from
+ * `nursery.promoted`.
+ */
+static void gc_evacuate(obj_t **slot)
+{
+  obj_t *obj = *slot;
+  if (!IS_ALLOC(obj))
+    return;
+  obj_t **fields = (obj_t **)UNTAG(obj);
+  if (!gc_is_young(fields))
+    return;
 
-  if (!gc->pool.chunks)
+  size_t idx = ((u8 *)fields - gc->nursery.start) / GC_SLOT_SIZE;
+  if (!bitmap_test(gc->nursery.forwarded, idx))
   {
-    FAIL("GC: failed to reallocate pool of chunks");
+    obj_t **copy = gc_alloc_old(fields[0], fields[1]);
+    bitmap_set(gc->nursery.forwarded, idx);
+    fields[0] = (obj_t *)copy;
+    vec_push(&gc->nursery.promoted, TAG_CANON(copy, get_tag(obj)));
+    ++gc->metadata.slots_promoted;
+    // Promoting an object is a write into the old generation.
+    if (gc->incremental.marking)
+      gc_shade(TAG_CANON(copy, get_tag(obj)));
   }
+  *slot = TAG_CANON(fields[0], get_tag(obj));
+}
 
-  gc->pool.chunks[gc->pool.length++] = c;
+void gc_write_barrier(obj_t *obj)
+{
+  void *raw = (void *)UNTAG(obj);
+  if (!IS_ALLOC(obj) || gc_is_young(raw))
+    return;
+  assert(gc_is_old(raw));
+  vec_push(&gc->nursery.remembered, obj);
 
-  return c;
+  // If `obj` has already been marked, its new field may not have been: make
+  // it grey again so its fields get another look.
+  if (gc->incremental.marking &&
+      bitmap_test(GC_CHUNK_OF(raw)->mark_bits, GC_SLOT_OF(raw)))
+    vec_push(&gc->incremental.grey, obj);
 }
 
-/** Locate which chunk owns a raw pointer, returning it.
- * If no chunk is found, return NULL.
-
- * The slot position of the pointer in the chunk is stored in `slot_id`.
+/** Set where allocation next stops to come back to `gc_make_room`.
  */
-static inline gc_chunk_t *gc_find_chunk(void *raw_ptr, size_t *slot_id)
+static void gc_nursery_limit(void)
 {
-  for (size_t i = 0; i < gc->pool.length; ++i)
-  {
-    auto c = gc->pool.chunks[i];
-    if (gc_ptr_in_chunk(c, raw_ptr))
-    {
-      *slot_id = gc_ptr_slot_in_chunk(c, raw_ptr);
-      return c;
-    }
-  }
-  return NULL;
+  // Come back after a few allocations to continue an incremental mark.
+  u8 *increment     = gc->nursery.top + GC_INCREMENT_SLOTS * GC_SLOT_SIZE;
+  gc->nursery.limit = gc->incremental.marking
+                          ? MIN(gc->nursery.end, increment)
+                          : gc->nursery.end;
+
+  // ...or to take the next sample.
+  u64 ahead = gc->profile.next - gc_allocated();
+  if (gc->profile.interval &&
+      ahead < (u64)(gc->nursery.limit - gc->nursery.top) / GC_SLOT_SIZE)
+    gc->nursery.limit = gc->nursery.top + ahead * GC_SLOT_SIZE;
 }
 
-static inline bool gc_threshold_met(void)
+/** Do whatever work the GC needs before the next allocation (made by `site`):
+ * collect the nursery when it's full, start or advance a major collection, and
+ * sample the allocation if it's due.
+ */
+static void gc_make_room(const char *site)
 {
-  return gc->metadata.slots_live >= gc->metadata.threshold;
+  u64 start = gc_clock();
+
+  if (!gc->nursery.start)
+    gc_nursery_init();
+  else if (gc->nursery.top == gc->nursery.end)
+    gc_minor();
+
+  if (gc->incremental.marking)
+    gc_mark_increment();
+  else if (gc_threshold_met() && gc->incremental.budget && !gc->compact)
+    gc_mark_start();
+  else if (gc_threshold_met())
+    gc_collect();
+  gc_snapshot_poll();
+
+  if (gc->profile.interval && gc_allocated() >= gc->profile.next)
+    gc_profile_sample(site);
+  gc_nursery_limit();
+
+  gc_pause_log(start);
+  gc_stats_poll();
 }
 
-__attribute__((noinline)) obj_t **gc_alloc()
+__attribute__((noinline)) obj_t **gc_alloc(obj_t *first, obj_t *second,
+                                           const char *site)
 {
-  if (gc_threshold_met())
+  if (gc->nursery.top == gc->nursery.limit)
   {
-    gc_collect();
+    // The fields of the new allocation may only be held by our caller.
+    gc_root(&first);
+    gc_root(&second);
+    gc_make_room(site);
+    gc_unroot(2);
   }
-  if (!gc->free_list)
+
+  obj_t **fields = (obj_t **)gc->nursery.top;
+  gc->nursery.top += GC_SLOT_SIZE;
+  fields[0] = first;
+  fields[1] = second;
+  return fields;
+}
+
+void gc_alloc_chunks(u64 count, gc_chunk_t **chunks)
+{
+  for (u64 i = 0; count; ++i)
   {
+    gc_chunk_t *c = chunks[i] = gc_new_chunk();
+    u64 slots     = MIN(count, GC_CHUNK_USABLE_SLOTS);
+    for (u64 s = GC_CHUNK_FIRST_SLOT; s < GC_CHUNK_FIRST_SLOT + slots; ++s)
+      bitmap_set(c->live_bits, s);
+    // Allocated black during a mark, like anything promoted.
+    if (gc->incremental.marking)
+    {
+      memcpy(c->mark_bits, c->live_bits, sizeof(c->mark_bits));
+      gc->metadata.slots_marked += slots;
+    }
+    gc->metadata.slots_live += slots;
+    count -= slots;
+  }
+}
+
+/******************************************************************************
+ * Collection                                                                 *
+ ******************************************************************************/
+
+/** Call `visit` on every root, including the fields of compiled code.
+ * If `minor`, only code compiled since the last minor collection is visited:
+ * older code can't point into the nursery.
+ */
+static void gc_visit_roots(void (*visit)(obj_t **), bool minor)
+{
+  for (u64 i = 0; i < gc->roots.length; ++i)
+    visit(gc->roots.slots[i]);
+  for (u64 i = 0; i < state->stack.length; ++i)
+    visit(&state->stack.items[i]);
+  // Only the input being read from can have lists open, and only the program
+  // can be an image.
+  for (u64 i = 0; i < state->reader->open.length; ++i)
+    visit(&state->reader->open.items[i]);
+  visit(&state->source.forms);
+  visit(&state->env);
+
 #if DEBUG & DEBUG_GC
-    printf("GC:alloc: New chunk - no freelist\n");
+  printf("GC:roots:frames: visiting %lu frames.\n", state->fstack.length);
 #endif
-    gc_new_chunk();
+  for (u64 i = 0; i < state->fstack.length; ++i)
+  {
+    visit(&state->fstack.frames[i].body);
+    visit(&state->fstack.frames[i].source);
+    visit(&state->fstack.frames[i].env);
   }
 
-  gc_free_slot_t *slot = gc_free_list_pop();
+  vec_t *codes = minor ? &state->codes_fresh : &state->codes;
+  for (u64 i = 0; i < codes->length; ++i)
+    code_visit(as_code(codes->items[i]), visit);
+}
+
+static void gc_mark_root(obj_t **slot)
+{
+  gc_mark_obj(*slot);
+}
 
+void gc_minor(void)
+{
 #if DEBUG & DEBUG_GC
-  // Ensure liveness invariant is met - only done in debug builds.
-  assert(
-      !bitmap_test(gc->pool.chunks[slot->chunk_id]->live_bits, slot->slot_id));
+  printf("GC:minor: %lu slots allocated in nursery.\n",
+         (gc->nursery.top - gc->nursery.start) / GC_SLOT_SIZE);
 #endif
+  ++gc->metadata.num_minor_collections;
+  u64 start = gc_clock();
 
-  gc->metadata.slots_live++;
+  gc_visit_roots(gc_evacuate, true);
+  for (u64 i = 0; i < gc->nursery.remembered.length; ++i)
+  {
+    obj_t **fields = (obj_t **)UNTAG(gc->nursery.remembered.items[i]);
+    gc_evacuate(&fields[0]);
+    gc_evacuate(&fields[1]);
+  }
+
+  // Evacuating an object only copies it, so every copy must have its fields
+  // evacuated in turn.  This is the only work proportional to the heap, and
+  // it's bounded by the survivors.
+  for (obj_t *obj; vec_try_pop(&gc->nursery.promoted, &obj);)
+  {
+    obj_t **fields = (obj_t **)UNTAG(obj);
+    gc_evacuate(&fields[0]);
+    gc_evacuate(&fields[1]);
+  }
+  gc_profile_retain(gc_profile_promoted);
 
-  gc_chunk_t *c = gc->pool.chunks[slot->chunk_id];
-  bitmap_set(c->live_bits, slot->slot_id);
-  memset(slot, 0, sizeof(*slot));
+  size_t used = (gc->nursery.top - gc->nursery.start) / GC_SLOT_SIZE;
+  memset(gc->nursery.forwarded, 0, ((used + 63) / 64) * sizeof(u64));
+  gc->metadata.slots_allocated += used;
+  gc->metadata.slots_live_peak =
+      MAX(gc->metadata.slots_live_peak, gc->metadata.slots_live);
+  gc->nursery.top               = gc->nursery.start;
+  gc->nursery.remembered.length = 0;
+  state->codes_fresh.length     = 0;
 
-  return (obj_t **)slot;
+  gc_pause(&gc->metadata.pauses_minor, start);
 }
 
+/** Mark everything reachable from `obj`, depth first.
+
+ * A plain depth first mark waits on a cache miss for almost every object of a
+ * heap that's scattered.  Instead, objects popped off the stack go through a
+ * FIFO of `gc->prefetch` objects, and are prefetched as they go in.  By the
+ * time an object comes out, the loads of those behind it are in flight.
+ */
 void gc_mark_obj(obj_t *obj)
 {
   if (!IS_ALLOC(obj))
@@ -207,22 +757,54 @@ void gc_mark_obj(obj_t *obj)
   u64 mark_sp           = 0;
   mark_stack[mark_sp++] = obj;
 
-  while (mark_sp > 0)
+  // Ring buffer: objects `[head, tail)` are queued, wrapping around.
+  constexpr u64 FIFO_MASK = GC_MARK_PREFETCH_MAX - 1;
+  void *fifo[GC_MARK_PREFETCH_MAX];
+  u64 head  = 0;
+  u64 tail  = 0;
+  u64 depth = gc->prefetch;
+
+  for (;;)
   {
-    obj_t *item = mark_stack[--mark_sp];
+    void *raw;
+    if (mark_sp > 0)
+    {
+      // Every pair and closure is an allocation of ours, so there's no need to
+      // validate the chunk here (roots are precise).
+      raw = (void *)UNTAG(mark_stack[--mark_sp]);
+      // With nothing else to hand there's nothing to overlap the load with.
+      if (depth && mark_sp > 0)
+      {
+        __builtin_prefetch(raw);
+        void *next = raw;
+        if (tail - head < depth)
+        {
+          fifo[tail++ & FIFO_MASK] = next;
+          continue;
+        }
+        raw                      = fifo[head++ & FIFO_MASK];
+        fifo[tail++ & FIFO_MASK] = next;
+      }
+    }
+    else if (head != tail)
+      raw = fifo[head++ & FIFO_MASK];
+    else
+      break;
 
-    void *raw     = (void *)UNTAG(item);
-    size_t idx    = 0;
-    gc_chunk_t *c = gc_find_chunk(raw, &idx);
+    gc_chunk_t *c = GC_CHUNK_OF(raw);
+    size_t idx    = GC_SLOT_OF(raw);
 
-    if (!c || bitmap_test(c->mark_bits, idx))
+    if (bitmap_test(c->mark_bits, idx))
       continue;
 
     bitmap_set(c->mark_bits, idx);
+    ++gc->metadata.slots_marked;
 
-    // pair_t and clos_t both start with two obj_t* fields
+    // pair_t and clos_t both start with two obj_t* fields.  The second is
+    // pushed first, so a list of lists takes as much of the stack as it
+    // nests rather than as long as it is.
     obj_t **fields = (obj_t **)raw;
-    for (size_t i = 0; i < 2; ++i)
+    for (size_t i = 2; i-- > 0;)
     {
       if (!IS_ALLOC(fields[i]))
         continue;
@@ -234,143 +816,1365 @@ void gc_mark_obj(obj_t *obj)
   }
 }
 
-size_t gc_sweep(void)
+void gc_mark_prefetch(u64 depth)
 {
-#if DEBUG & DEBUG_GC
-  printf("GC:sweep: starting...\n");
-#endif
-  // We must iterate through every chunk and look for unmarked live allocations
-  // to eat up into our free list.
-  size_t freed = 0;
-  for (size_t i = 0; i < gc->pool.length; ++i)
-  {
-    gc_chunk_t *c = gc->pool.chunks[i];
-    for (size_t w = 0; w < GC_CHUNK_MARK_WORDS; ++w)
-    {
-      // We only want to free those that are both live and unmarked.
-      u64 to_free = c->live_bits[w] & ~c->mark_bits[w];
-      size_t base = w * 64;
-
-#if DEBUG & DEBUG_GC
-      if (to_free)
-      {
-        printf("\t%lu@%lu...%lu => %d slots to free.\n", i, w * 64,
-               (w + 1) * 64, stdc_count_ones(to_free));
-      }
-#endif
+  gc->prefetch = MIN(depth, GC_MARK_PREFETCH_MAX);
+}
 
-      for (u64 todo = to_free; todo; todo &= todo - 1)
-      {
-        // Find the lowest bit which is nonzero through a single hardware inst.
-        int bit           = stdc_trailing_zeros_ull(todo);
-        size_t slot_index = base + bit;
+/******************************************************************************
+ * Incremental marking                                                        *
+ ******************************************************************************/
 
-        // Put the slot designated by the bit into the free list.
-        void *slot = c->data + slot_index * 16;
-        gc_free_list_push(slot, i, slot_index);
-      }
+/// Grey objects marked between checks of the clock.
+#define GC_INCREMENT_BATCH (256)
 
-      // Clear all live bits in one go.
-      freed += stdc_count_ones(to_free);
-      c->live_bits[w] &= ~to_free;
-    }
-    memset(c->mark_bits, 0, sizeof(c->mark_bits));
-  }
+/** Mark `obj` grey: marked, with fields yet to be marked.  Young objects are
+ * left alone, they're shaded when promoted.
+ */
+static void gc_shade(obj_t *obj)
+{
+  void *raw = (void *)UNTAG(obj);
+  if (!IS_ALLOC(obj) || gc_is_young(raw))
+    return;
 
-  gc->metadata.slots_live -= freed;
-  gc->metadata.threshold =
-      MAX(GC_THRESHOLD_DEFAULT, gc->metadata.slots_live * 2);
+  gc_chunk_t *c = GC_CHUNK_OF(raw);
+  size_t idx    = GC_SLOT_OF(raw);
+  if (bitmap_test(c->mark_bits, idx))
+    return;
+  bitmap_set(c->mark_bits, idx);
+  ++gc->metadata.slots_marked;
+  vec_push(&gc->incremental.grey, obj);
+}
 
-#if DEBUG & DEBUG_GC
-  printf("GC:sweep: slots_live: %lu\n", gc->metadata.slots_live);
-  printf("GC:sweep: threshold: %lu\n", gc->metadata.threshold);
-  printf("GC:sweep: freed %lu slots\n", freed);
-#endif
-  return freed;
+static void gc_shade_root(obj_t **slot)
+{
+  gc_shade(*slot);
 }
 
-/** Perform a march through the machine stack, marking objects.
- * This march is done up from the current `rsp` by GC_STACK_MARCH_LIMIT words.
- * Each word is checked to see if it is a valid object that may have been
- * allocated.
+/** Mark the fields of up to `n` grey objects, making them black.
+ * Returns whether any are left.
  */
-static inline void gc_mark_stack_march(void)
+static bool gc_mark_grey(u64 n)
 {
-  constexpr size_t GC_STACK_MARCH_LIMIT = 512;
-  void *sp;
-  __asm__ volatile("mov %%rsp, %0" : "=r"(sp));
-  void **end = (void **)((u8 *)sp + GC_STACK_MARCH_LIMIT);
+  obj_t *obj;
+  for (; n > 0 && vec_try_pop(&gc->incremental.grey, &obj); --n)
+  {
+    obj_t **fields = (obj_t **)UNTAG(obj);
+    gc_shade(fields[0]);
+    gc_shade(fields[1]);
+  }
+  return gc->incremental.grey.length > 0;
+}
 
+/** Start an incremental mark by shading the roots.
+ */
+static void gc_mark_start(void)
+{
 #if DEBUG & DEBUG_GC
-  printf("GC:collect:stack_march: Iterating from start=%p -> end=%p\n", sp,
-         (void *)end);
+  printf("GC:incremental: Starting as %lu live slots vs %lu threshold.\n",
+         gc->metadata.slots_live, gc->metadata.threshold);
 #endif
+  u64 start = gc_clock();
+
+  // The last cycle's marks must have all been swept.
+  gc_sweep();
+  gc->metadata.slots_marked = 0;
+  gc->incremental.marking   = true;
+  gc_visit_roots(gc_shade_root, false);
 
-  size_t _ = 0;
-  for (void **p = sp; p < end; ++p)
+  gc_pause(&gc->metadata.pauses_mark, start);
+}
+
+/** Mark grey objects until the budget runs out, finishing the mark if there
+ * are none left.
+ */
+static void gc_mark_increment(void)
+{
+  u64 start = gc_clock();
+  while (gc_mark_grey(GC_INCREMENT_BATCH))
   {
-    obj_t *maybe = *(obj_t **)p;
-    if (IS_ALLOC(maybe))
+    if (gc_clock() - start >= gc->incremental.budget)
     {
-      void *raw = (void *)UNTAG(maybe);
-      if (gc_find_chunk(raw, &_))
-      {
-#if DEBUG & DEBUG_GC
-        printf("GC:collect:stack_march: Marking allocation %p => %p\n",
-               (void *)p, raw);
-#endif
-        gc_mark_obj(maybe);
-      }
+      gc_pause(&gc->metadata.pauses_mark, start);
+      return;
     }
   }
+  gc_pause(&gc->metadata.pauses_mark, start);
+  gc_collect();
 }
 
-size_t gc_collect(void)
+void gc_incremental(u64 budget_us)
 {
-#if DEBUG & DEBUG_GC
-  ++gc->metadata.num_collections;
-  printf("GC:collect: Triggered as %lu live slots vs %lu threshold.\n",
-         gc->metadata.slots_live, gc->metadata.threshold);
+  if (gc->incremental.marking)
+    gc_collect();
+  gc->incremental.budget = budget_us * 1000;
+}
+
+/******************************************************************************
+ * Parallel marking                                                           *
+ ******************************************************************************/
+
+/// Markers with more than this many objects to mark give some away.
+#define GC_MARK_SHARE_THRESHOLD (64)
+/// Times an idle marker yields before it starts sleeping.
+#define GC_MARK_SPINS (64)
+
+static gc_markers_t *markers = &state->gc.markers;
+
+/** Move half of `from` onto the end of `to`.  One of them is shared, so this
+ * is done under its owner's lock.
+ */
+static inline void gc_marker_move_half(vec_t *to, vec_t *from)
+{
+  u64 n = (from->length + 1) / 2;
+  if (to->capacity - to->length < n)
+  {
+    to->capacity = MAX(to->length + n, to->capacity * 2);
+    to->items    = realloc(to->items, to->capacity * sizeof(*to->items));
+    if (!to->items)
+      FAIL("GC: failed to reallocate mark stack");
+  }
+  memcpy(to->items + to->length, from->items + from->length - n,
+         n * sizeof(*to->items));
+  // Others look at whether a shared stack is empty without taking its lock,
+  // so its length is only ever written atomically.
+  __atomic_store_n(&to->length, to->length + n, __ATOMIC_RELAXED);
+  __atomic_store_n(&from->length, from->length - n, __ATOMIC_RELAXED);
+}
+
+/** Try to take work from `victim`'s shared objects into `self`'s local ones.
+ */
+static bool gc_marker_take(gc_marker_t *self, gc_marker_t *victim)
+{
+  if (!__atomic_load_n(&victim->shared.length, __ATOMIC_RELAXED))
+    return false;
+
+  pthread_mutex_lock(&victim->lock);
+  bool taken = victim->shared.length > 0;
+  if (taken)
+    gc_marker_move_half(&self->local, &victim->shared);
+  pthread_mutex_unlock(&victim->lock);
+  return taken;
+}
+
+/** Try to take work from our own shared objects, then steal from the others.
+ */
+static bool gc_marker_steal(gc_marker_t *self)
+{
+  if (gc_marker_take(self, self))
+    return true;
+  u64 id = self - markers->markers;
+  for (u64 i = 1; i < markers->length; ++i)
+    if (gc_marker_take(self, &markers->markers[(id + i) % markers->length]))
+      return true;
+  return false;
+}
+
+static bool gc_marker_work_available(void)
+{
+  for (u64 i = 0; i < markers->length; ++i)
+    if (__atomic_load_n(&markers->markers[i].shared.length, __ATOMIC_RELAXED))
+      return true;
+  return false;
+}
+
+/** Mark everything in `self->local`, sharing some when others may need it.
+ */
+static void gc_marker_drain(gc_marker_t *self)
+{
+  // Keep the stack in locals: the compiler can't otherwise tell the fields we
+  // load apart from `self`.
+  vec_t local = self->local;
+  u64 marked  = 0;
+  while (local.length)
+  {
+    void *raw     = (void *)UNTAG(local.items[--local.length]);
+    gc_chunk_t *c = GC_CHUNK_OF(raw);
+    // Only an object not yet marked costs a locked instruction: the bit is
+    // tested with a plain load first.
+    if (!bitmap_test_and_set(c->mark_bits, GC_SLOT_OF(raw)))
+      continue;
+    ++marked;
+
+    // Popping made room for one push, so only the second may grow the stack.
+    obj_t **fields = (obj_t **)raw;
+    if (IS_ALLOC(fields[0]))
+      local.items[local.length++] = fields[0];
+    if (IS_ALLOC(fields[1]))
+      vec_push(&local, fields[1]);
+
+    if (local.length > GC_MARK_SHARE_THRESHOLD &&
+        !__atomic_load_n(&self->shared.length, __ATOMIC_RELAXED))
+    {
+      pthread_mutex_lock(&self->lock);
+      gc_marker_move_half(&self->shared, &local);
+      pthread_mutex_unlock(&self->lock);
+    }
+  }
+  self->local = local;
+  self->marked += marked;
+}
+
+/** Mark everything reachable from the objects given to `self`, sharing and
+ * stealing work until every marker is out of it.
+ *
+ * Only the owner of a shared stack pushes to it, and it must be empty before
+ * its owner goes idle.  So once every marker is idle, there's nothing left.
+ */
+static void gc_marker_run(gc_marker_t *self)
+{
+  for (;;)
+  {
+    gc_marker_drain(self);
+    if (gc_marker_steal(self))
+      continue;
+
+    // Out of work: wait for everyone else to be, unless some turns up.  Back
+    // off while waiting so we don't take cores from markers with work.
+    __atomic_add_fetch(&markers->idle, 1, __ATOMIC_SEQ_CST);
+    for (u64 spins = 0;; ++spins)
+    {
+      if (__atomic_load_n(&markers->idle, __ATOMIC_SEQ_CST) == markers->length)
+        return;
+      else if (gc_marker_work_available())
+      {
+        __atomic_sub_fetch(&markers->idle, 1, __ATOMIC_SEQ_CST);
+        break;
+      }
+      else if (spins < GC_MARK_SPINS)
+        sched_yield();
+      else
+        nanosleep(&(struct timespec){.tv_nsec = 10000}, NULL);
+    }
+  }
+}
+
+static void *gc_marker_thread(void *arg)
+{
+  gc_marker_t *self = arg;
+  for (;;)
+  {
+    pthread_barrier_wait(&markers->start);
+    if (markers->stopping)
+      return NULL;
+    gc_marker_run(self);
+    pthread_barrier_wait(&markers->done);
+  }
+}
+
+/** Hand out roots between the markers, round robin.
+ */
+static void gc_marker_give_root(obj_t **slot)
+{
+  if (!IS_ALLOC(*slot))
+    return;
+  gc_marker_t *marker =
+      &markers->markers[markers->next_root++ % markers->length];
+  vec_push(&marker->shared, *slot);
+}
+
+/** Mark from every root with all markers.
+ */
+static void gc_mark_parallel(void)
+{
+  markers->idle      = 0;
+  markers->next_root = 0;
+  for (u64 i = 0; i < markers->length; ++i)
+    markers->markers[i].marked = 0;
+  gc_visit_roots(gc_marker_give_root, false);
+
+  pthread_barrier_wait(&markers->start);
+  gc_marker_run(&markers->markers[0]);
+  pthread_barrier_wait(&markers->done);
+
+  for (u64 i = 0; i < markers->length; ++i)
+    gc->metadata.slots_marked += markers->markers[i].marked;
+}
+
+void gc_mark_threads(u64 threads)
+{
+  threads = MIN(threads, GC_MARK_THREADS_MAX);
+  if (markers->length > 1)
+  {
+    markers->stopping = true;
+    pthread_barrier_wait(&markers->start);
+    for (u64 i = 0; i < markers->length; ++i)
+    {
+      if (i > 0)
+        pthread_join(markers->markers[i].thread, NULL);
+      pthread_mutex_destroy(&markers->markers[i].lock);
+      vec_stop(&markers->markers[i].shared);
+      vec_stop(&markers->markers[i].local);
+    }
+    pthread_barrier_destroy(&markers->start);
+    pthread_barrier_destroy(&markers->done);
+    free(markers->markers);
+  }
+  memset(markers, 0, sizeof(*markers));
+  if (threads < 2)
+    return;
+
+  markers->length  = threads;
+  markers->markers = calloc(threads, sizeof(*markers->markers));
+  if (!markers->markers)
+  {
+    FAIL("GC: failed to allocate markers");
+  }
+  pthread_barrier_init(&markers->start, NULL, threads);
+  pthread_barrier_init(&markers->done, NULL, threads);
+  for (u64 i = 0; i < threads; ++i)
+  {
+    pthread_mutex_init(&markers->markers[i].lock, NULL);
+    if (i > 0 && pthread_create(&markers->markers[i].thread, NULL,
+                                gc_marker_thread, &markers->markers[i]))
+    {
+      FAIL("GC: failed to start marker thread");
+    }
+  }
+}
+
+/** Kernels for sweeping the bitmaps of a chunk, see `gc_sweep_kernel_t`.
+
+ * The vector kernels work through blocks of the bitmaps, skipping blocks with
+ * nothing live and leaving the live bits alone where everything is marked, so
+ * the only writes to a mostly empty or mostly live chunk are clearing marks.
+ */
+static bool gc_sweep_always(void)
+{
+  return true;
+}
+
+static size_t gc_sweep_scalar(u64 *restrict live, u64 *restrict mark)
+{
+  size_t freed = 0;
+  for (size_t w = 0; w < GC_CHUNK_MARK_WORDS; ++w)
+  {
+    u64 dead = live[w] & ~mark[w];
+    freed += stdc_count_ones(dead);
+    live[w] ^= dead;
+  }
+  memset(mark, 0, GC_CHUNK_MARK_WORDS * sizeof(*mark));
+  return freed;
+}
+
+#if GC_SWEEP_X86
+static_assert(GC_CHUNK_MARK_WORDS % 4 == 0);
+
+static bool gc_sweep_has_sse42(void)
+{
+  return __builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt");
+}
+
+[[gnu::target("sse4.2,popcnt")]] static size_t
+gc_sweep_sse42(u64 *restrict live, u64 *restrict mark)
+{
+  size_t freed = 0;
+  for (size_t w = 0; w < GC_CHUNK_MARK_WORDS; w += 2)
+  {
+    __m128i l = _mm_loadu_si128((const __m128i *)(live + w));
+    __m128i m = _mm_loadu_si128((const __m128i *)(mark + w));
+    if (_mm_testz_si128(m, m))
+    {
+      if (_mm_testz_si128(l, l))
+        continue;
+      // Nothing marked: everything live is dead.
+      freed += _mm_popcnt_u64(live[w]) + _mm_popcnt_u64(live[w + 1]);
+      _mm_storeu_si128((__m128i *)(live + w), m);
+      continue;
+    }
+
+    __m128i dead = _mm_andnot_si128(m, l);
+    if (!_mm_testz_si128(dead, dead))
+    {
+      freed += _mm_popcnt_u64(_mm_cvtsi128_si64(dead)) +
+               _mm_popcnt_u64(_mm_extract_epi64(dead, 1));
+      _mm_storeu_si128((__m128i *)(live + w), _mm_and_si128(l, m));
+    }
+    _mm_storeu_si128((__m128i *)(mark + w), _mm_setzero_si128());
+  }
+  return freed;
+}
+
+static bool gc_sweep_has_avx2(void)
+{
+  return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt");
+}
+
+[[gnu::target("avx2,popcnt")]] static size_t
+gc_sweep_avx2(u64 *restrict live, u64 *restrict mark)
+{
+  size_t freed = 0;
+  for (size_t w = 0; w < GC_CHUNK_MARK_WORDS; w += 4)
+  {
+    __m256i l = _mm256_loadu_si256((const __m256i *)(live + w));
+    __m256i m = _mm256_loadu_si256((const __m256i *)(mark + w));
+    if (_mm256_testz_si256(m, m))
+    {
+      if (_mm256_testz_si256(l, l))
+        continue;
+      for (size_t i = 0; i < 4; ++i)
+        freed += _mm_popcnt_u64(live[w + i]);
+      _mm256_storeu_si256((__m256i *)(live + w), m);
+      continue;
+    }
+
+    __m256i dead = _mm256_andnot_si256(m, l);
+    if (!_mm256_testz_si256(dead, dead))
+    {
+      freed += _mm_popcnt_u64(_mm256_extract_epi64(dead, 0)) +
+               _mm_popcnt_u64(_mm256_extract_epi64(dead, 1)) +
+               _mm_popcnt_u64(_mm256_extract_epi64(dead, 2)) +
+               _mm_popcnt_u64(_mm256_extract_epi64(dead, 3));
+      _mm256_storeu_si256((__m256i *)(live + w), _mm256_and_si256(l, m));
+    }
+    _mm256_storeu_si256((__m256i *)(mark + w), _mm256_setzero_si256());
+  }
+  return freed;
+}
 #endif
 
-  gc_mark_stack_march();
-  gc_mark_obj(state->stack);
-  gc_mark_obj(state->env);
+/// Available kernels, widest first.
+static const gc_sweep_kernel_t gc_sweep_kernels[] = {
+#if GC_SWEEP_X86
+    {"avx2", gc_sweep_has_avx2, gc_sweep_avx2},
+    {"sse4.2", gc_sweep_has_sse42, gc_sweep_sse42},
+#endif
+    {"scalar", gc_sweep_always, gc_sweep_scalar},
+};
+
+bool gc_sweep_kernel(const char *name)
+{
+  for (u64 i = 0; i < ARRSIZE(gc_sweep_kernels); ++i)
+  {
+    const gc_sweep_kernel_t *kernel = &gc_sweep_kernels[i];
+    if ((!name || !strcmp(name, kernel->name)) && kernel->supported())
+    {
+      gc->sweeper.kernel = kernel;
+      return true;
+    }
+  }
+  return false;
+}
 
+/** Sweep chunk `c`: every unmarked slot is no longer live.  Dead slots are
+ * never touched, only the bitmaps.
+ * Returns number freed.
+ */
+static size_t gc_sweep_chunk(gc_chunk_t *c)
+{
 #if DEBUG & DEBUG_GC
-  printf("GC:collect:frames: marking %lu frames.\n", state->fstack.length);
+  for (size_t w = 0; w < GC_CHUNK_MARK_WORDS; ++w)
+  {
+    u64 to_free = c->live_bits[w] & ~c->mark_bits[w];
+    if (to_free)
+    {
+      printf("\t%p@%lu...%lu => %d slots to free.\n", (void *)c, w * 64,
+             (w + 1) * 64, stdc_count_ones(to_free));
+    }
+  }
 #endif
-  for (u64 i = 0; i < state->fstack.length; ++i)
+  return gc->sweeper.kernel->sweep(c->live_bits, c->mark_bits);
+}
+
+/** Sweep the next chunk waiting to be swept, if any.
+ * Returns true if there was one.
+ */
+static bool gc_sweep_step(size_t *freed)
+{
+  if (gc->sweeper.next == gc->sweeper.end)
+    return false;
+
+  u64 start = gc_clock();
+  *freed += gc_sweep_chunk(gc->pool.chunks[gc->sweeper.next++]);
+  gc_pause(&gc->metadata.pauses_sweep, start);
+  return true;
+}
+
+size_t gc_sweep(void)
+{
+  size_t freed = 0;
+  while (gc_sweep_step(&freed))
+    continue;
+  return freed;
+}
+
+/******************************************************************************
+ * Compaction                                                                 *
+ ******************************************************************************/
+
+/** Forward `obj` to its copy in to-space (the current pool), copying it if it
+ * hasn't been yet.  Both bitmaps of a from-space chunk are free for our use,
+ * as it's about to be freed:
+ * - A from-space slot which has been copied is no longer live, and its first
+ *   field holds the address of its copy.
+ * - Slots in to-space are marked.  Marks are otherwise clear, as from-space
+ *   marks are cleared before copying.
+
+ * If `obj` is a pair, the rest of its list is copied right after it, so that
+ * following cdrs walks memory in order.
+ */
+static obj_t *gc_compact_forward(obj_t *obj)
+{
+  if (!IS_ALLOC(obj))
+    return obj;
+  obj_t **fields = (obj_t **)UNTAG(obj);
+  gc_chunk_t *c  = GC_CHUNK_OF(fields);
+  size_t idx     = GC_SLOT_OF(fields);
+  if (bitmap_test(c->mark_bits, idx))
+    return obj;
+  else if (!bitmap_test(c->live_bits, idx))
+    return TAG_CANON(fields[0], get_tag(obj));
+
+  obj_t *head = NULL;
+  for (obj_t **prev = NULL; obj;)
+  {
+    obj_t **copy = gc_alloc_old(fields[0], fields[1]);
+    bitmap_set(GC_CHUNK_OF(copy)->mark_bits, GC_SLOT_OF(copy));
+    bitmap_clear(c->live_bits, idx);
+    fields[0] = (obj_t *)copy;
+    ++gc->metadata.slots_marked;
+
+    obj_t *forwarded = TAG_CANON(copy, get_tag(obj));
+    if (prev)
+      prev[1] = forwarded;
+    else
+      head = forwarded;
+
+    // Carry on down the list while its cdrs are yet to be copied.
+    obj = NULL;
+    if (IS_PAIR(forwarded) && IS_PAIR(copy[1]))
+    {
+      fields = (obj_t **)UNTAG(copy[1]);
+      c      = GC_CHUNK_OF(fields);
+      idx    = GC_SLOT_OF(fields);
+      if (!bitmap_test(c->mark_bits, idx) && bitmap_test(c->live_bits, idx))
+      {
+        obj  = copy[1];
+        prev = copy;
+      }
+    }
+  }
+  return head;
+}
+
+static void gc_compact_root(obj_t **slot)
+{
+  *slot = gc_compact_forward(*slot);
+}
+
+/** Copy everything reachable in the old generation into new chunks, then free
+ * the old ones.  The nursery must be empty.
+ */
+static void gc_compact_old(void)
+{
+  gc_pool_t from = gc->pool;
+  for (u64 i = 0; i < from.length; ++i)
+    memset(from.chunks[i]->mark_bits, 0, sizeof(from.chunks[i]->mark_bits));
+  // Copies are counted as marked, not as new allocations.
+  size_t live               = gc->metadata.slots_live;
+  gc->metadata.slots_marked = 0;
+  gc->pool                  = (gc_pool_t){0};
+  gc->sweeper.next          = 0;
+  gc->sweeper.end           = 0;
+  gc_cursor_reset();
+  // Whatever was being marked incrementally is in from-space.
+  gc->incremental.marking     = false;
+  gc->incremental.grey.length = 0;
+
+  gc_visit_roots(gc_compact_root, false);
+
+  // Scan to-space in the order it was allocated in.  Chunks in to-space are
+  // allocated from start to end without gaps, so the first slot which isn't
+  // live is where allocation has got to.
+  for (u64 i = 0; i < gc->pool.length; ++i)
+  {
+    gc_chunk_t *c = gc->pool.chunks[i];
+    for (size_t idx = GC_CHUNK_FIRST_SLOT;
+         idx < GC_CHUNK_SLOTS && bitmap_test(c->live_bits, idx); ++idx)
+    {
+      obj_t **fields = (obj_t **)(c->data + idx * GC_SLOT_SIZE);
+      fields[0]      = gc_compact_forward(fields[0]);
+      fields[1]      = gc_compact_forward(fields[1]);
+    }
+  }
+  gc_profile_retain(gc_profile_copied);
+
+  for (u64 i = 0; i < gc->pool.length; ++i)
+  {
+    gc_chunk_t *c = gc->pool.chunks[i];
+    memset(c->mark_bits, 0, sizeof(c->mark_bits));
+  }
+  for (u64 i = 0; i < from.length; ++i)
+    gc_chunk_release(from.chunks[i]);
+  free(from.chunks);
+
+  // Allocation carries on from the end of the survivors, with nothing to
+  // sweep.
+  gc->sweeper.next        = gc->pool.length;
+  gc->sweeper.end         = gc->pool.length;
+  gc->metadata.slots_live = live;
+}
+
+/******************************************************************************
+ * Releasing chunks                                                           *
+ ******************************************************************************/
+
+static inline bool gc_chunk_unmarked(const gc_chunk_t *c)
+{
+  u64 marked = 0;
+  for (size_t w = 0; w < GC_CHUNK_MARK_WORDS; ++w)
+    marked |= c->mark_bits[w];
+  return !marked;
+}
+
+/** Give chunks with nothing marked in them back to the OS, keeping enough to
+ * allocate up to the threshold plus some slack: GC_CHUNKS_SLACK, or a quarter
+ * as many again if that's more.  Must be called between marking and sweeping.
+ */
+static void gc_release_chunks(void)
+{
+  constexpr u64 usable = GC_CHUNK_SLOTS - GC_CHUNK_FIRST_SLOT;
+  u64 needed           = (gc->metadata.threshold + usable - 1) / usable;
+  u64 slack            = MAX(GC_CHUNKS_SLACK, needed / 4);
+  // We never keep fewer chunks than this, so don't bother looking.
+  if (gc->pool.length <= needed + slack)
+    return;
+
+  u64 empty = 0;
+  for (u64 i = 0; i < gc->pool.length; ++i)
+    empty += gc_chunk_unmarked(gc->pool.chunks[i]);
+
+  // Free slots in chunks which are still in use count towards what's needed.
+  u64 used    = gc->pool.length - empty;
+  u64 keep    = (MAX(gc->metadata.threshold, used * usable) + usable - 1) /
+                    usable -
+                used + slack;
+  u64 release = empty > keep ? empty - keep : 0;
+  if (!release)
+    return;
+
+#if DEBUG & DEBUG_GC
+  printf("GC:release: %lu of %lu empty chunks.\n", release, empty);
+#endif
+  u64 retained = 0;
+  for (u64 i = 0; i < gc->pool.length; ++i)
+  {
+    gc_chunk_t *c = gc->pool.chunks[i];
+    if (release && gc_chunk_unmarked(c))
+    {
+      gc_chunk_release(c);
+      --release;
+      ++gc->metadata.chunks_released;
+    }
+    else
+      gc->pool.chunks[retained++] = c;
+  }
+  gc->pool.length = retained;
+}
+
+void gc_compact(bool compact)
+{
+  gc->compact = compact;
+}
+
+size_t gc_collect(void)
+{
+  // Everything reachable must be in the old generation before marking.
+  gc_minor();
+
+#if DEBUG & DEBUG_GC
+  printf("GC:collect: Triggered as %lu live slots vs %lu threshold.\n",
+         gc->metadata.slots_live, gc->metadata.threshold);
+#endif
+  ++gc->metadata.num_collections;
+  u64 start = gc_clock();
+
+  if (gc->compact)
+    gc_compact_old();
+  else if (gc->incremental.marking)
+  {
+    // Finish the incremental mark.  The roots have changed under us without
+    // any barrier, so they must be shaded again.
+    gc_visit_roots(gc_shade_root, false);
+    while (gc_mark_grey(UINT64_MAX))
+      continue;
+    gc->incremental.marking = false;
+  }
+  else
   {
-    gc_mark_obj(state->fstack.frames[i].body);
-    gc_mark_obj(state->fstack.frames[i].env);
+    // The last cycle's marks must have all been swept.
+    gc_sweep();
+    gc->metadata.slots_marked = 0;
+    if (markers->length > 1)
+      gc_mark_parallel();
+    else
+      gc_visit_roots(gc_mark_root, false);
   }
+  if (!gc->compact)
+    gc_profile_retain(gc_profile_marked);
 
-  size_t freed = gc_sweep();
+  // Whatever wasn't marked is dead, but only freed once a sweep reaches it.
+  size_t dead = gc->metadata.slots_live - gc->metadata.slots_marked;
+  gc->metadata.slots_live = gc->metadata.slots_marked;
+  gc->metadata.slots_freed += dead;
+  gc->metadata.threshold  = gc_grow(gc->metadata.slots_live, dead);
+  if (gc->compact)
+    gc_pause(&gc->metadata.pauses_compact, start);
+  else
+  {
+    gc_release_chunks();
+    gc->sweeper.next = 0;
+    gc->sweeper.end  = gc->pool.length;
+    gc_cursor_reset();
+    gc_pause(&gc->metadata.pauses_mark, start);
+  }
 
 #if DEBUG & DEBUG_GC
+  printf("GC:collect: slots_live: %lu\n", gc->metadata.slots_live);
+  printf("GC:collect: threshold: %lu\n", gc->metadata.threshold);
+  printf("GC:collect: %lu slots dead\n", dead);
   BORDER();
 #endif
 
-  return freed;
+  gc_profile_dump();
+  return dead;
+}
+
+static void gc_stats_pauses(FILE *fp, const char *name, gc_pauses_t *pauses)
+{
+  fprintf(fp, "\t%-7s %7lu pauses, %10.3fms total, %8.3fms max.\n", name,
+          pauses->count, pauses->total / 1e6, pauses->max / 1e6);
 }
 
 void gc_stats(FILE *fp)
 {
-#if DEBUG & DEBUG_GC
   fprintf(fp,
           "stats\n"
           "\t%lu slots (%luB) over %lu %s allocated, of which %lu (%luB) are "
           "live.\n"
-          "\tCollected %lu times.\n",
-          (state->gc.pool.length * GC_CHUNK_DATA_SIZE) / 16,
-          state->gc.pool.length * GC_CHUNK_DATA_SIZE, state->gc.pool.length,
+          "\tCollected %lu times, with %lu minor collections promoting %lu "
+          "slots.\n",
+          state->gc.pool.length * (GC_CHUNK_SLOTS - GC_CHUNK_FIRST_SLOT),
+          state->gc.pool.length * GC_CHUNK_SIZE, state->gc.pool.length,
           state->gc.pool.length == 1 ? "chunk" : "chunks",
-          state->gc.metadata.slots_live, state->gc.metadata.slots_live * 16,
-          state->gc.metadata.num_collections);
-#else
-  (void)fp;
-#endif
+          state->gc.metadata.slots_live,
+          state->gc.metadata.slots_live * GC_SLOT_SIZE,
+          state->gc.metadata.num_collections,
+          state->gc.metadata.num_minor_collections,
+          state->gc.metadata.slots_promoted);
+  fprintf(fp,
+          "\tGrowing by the %s policy (%.2fx), next collecting at %lu "
+          "slots.\n",
+          state->gc.growth.policy->name, state->gc.growth.multiplier,
+          state->gc.metadata.threshold);
+  if (state->gc.metadata.chunks_released)
+    fprintf(fp, "\t%lu chunks released to the OS.\n",
+            state->gc.metadata.chunks_released);
+  gc_stats_pauses(fp, "minor", &state->gc.metadata.pauses_minor);
+  gc_stats_pauses(fp, "mark", &state->gc.metadata.pauses_mark);
+  gc_stats_pauses(fp, "sweep", &state->gc.metadata.pauses_sweep);
+  if (state->gc.metadata.pauses_compact.count)
+    gc_stats_pauses(fp, "compact", &state->gc.metadata.pauses_compact);
+
+  gc_histogram_t *histogram = &state->gc.metadata.pause_histogram;
+  if (!histogram->count)
+    return;
+  fprintf(fp,
+          "\t%lu pauses in gc_alloc: p50 < %.3fms, p99 < %.3fms, max "
+          "%.3fms.\n",
+          histogram->count, gc_histogram_percentile(histogram, 50) / 1e6,
+          gc_histogram_percentile(histogram, 99) / 1e6, histogram->max / 1e6);
+}
+
+/******************************************************************************
+ * Telemetry                                                                  *
+ ******************************************************************************/
+
+/// File `gc_stats_dump` appends to, if any.
+static const char *gc_stats_path = NULL;
+/// Set by SIGUSR1, cleared once stats have been dumped.
+static volatile sig_atomic_t gc_stats_requested = 0;
+
+static void gc_stats_json_pauses(FILE *fp, const char *name,
+                                 const gc_pauses_t *pauses)
+{
+  fprintf(fp, "\"%s\":{\"count\":%lu,\"total\":%lu,\"max\":%lu}", name,
+          pauses->count, pauses->total, pauses->max);
+}
+
+void gc_stats_json(FILE *fp, const char *reason)
+{
+  gc_metadata_t *metadata = &state->gc.metadata;
+  u64 allocated           = gc_allocated();
+  u64 swept_from          = metadata->slots_freed + metadata->slots_live;
+
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  fprintf(fp, "{\"reason\":\"%s\",\"time\":%.3f,", reason,
+          now.tv_sec + now.tv_nsec / 1e9);
+  fprintf(fp,
+          "\"collections\":%lu,\"minor_collections\":%lu,"
+          "\"allocated\":%lu,\"promoted\":%lu,\"freed\":%lu,"
+          "\"survival_minor\":%.4f,\"survival_major\":%.4f,"
+          "\"live\":%lu,\"live_peak\":%lu,\"threshold\":%lu,",
+          metadata->num_collections, metadata->num_minor_collections,
+          allocated * GC_SLOT_SIZE, metadata->slots_promoted * GC_SLOT_SIZE,
+          metadata->slots_freed * GC_SLOT_SIZE,
+          (f64)metadata->slots_promoted / MAX(1LU, allocated),
+          1 - (f64)metadata->slots_freed / MAX(1LU, swept_from),
+          metadata->slots_live * GC_SLOT_SIZE,
+          metadata->slots_live_peak * GC_SLOT_SIZE,
+          metadata->threshold * GC_SLOT_SIZE);
+  fprintf(fp,
+          "\"chunks\":%lu,\"chunks_peak\":%lu,\"chunks_released\":%lu,"
+          "\"policy\":\"%s\",\"multiplier\":%.2f,\"pauses\":{",
+          state->gc.pool.length, metadata->chunks_peak,
+          metadata->chunks_released, state->gc.growth.policy->name,
+          state->gc.growth.multiplier);
+  gc_stats_json_pauses(fp, "minor", &metadata->pauses_minor);
+  fprintf(fp, ",");
+  gc_stats_json_pauses(fp, "mark", &metadata->pauses_mark);
+  fprintf(fp, ",");
+  gc_stats_json_pauses(fp, "sweep", &metadata->pauses_sweep);
+  fprintf(fp, ",");
+  gc_stats_json_pauses(fp, "compact", &metadata->pauses_compact);
+
+  // Only buckets with any pauses in them, as [least pause, count] pairs.
+  gc_histogram_t *histogram = &metadata->pause_histogram;
+  fprintf(fp, "},\"alloc_pauses\":{\"count\":%lu,\"max\":%lu,\"p50\":%lu,"
+          "\"p99\":%lu,\"histogram\":[",
+          histogram->count, histogram->max,
+          gc_histogram_percentile(histogram, 50),
+          gc_histogram_percentile(histogram, 99));
+  bool first = true;
+  for (u64 i = 0; i < GC_HISTOGRAM_BUCKETS; ++i)
+  {
+    if (!histogram->buckets[i])
+      continue;
+    fprintf(fp, "%s[%lu,%lu]", first ? "" : ",", gc_histogram_floor(i),
+            histogram->buckets[i]);
+    first = false;
+  }
+  fprintf(fp, "]}}\n");
+}
+
+static void gc_stats_signal(int)
+{
+  gc_stats_requested = 1;
+}
+
+void gc_stats_on_signal(const char *path)
+{
+  gc_stats_path = path;
+  signal(SIGUSR1, path ? gc_stats_signal : SIG_DFL);
+}
+
+void gc_stats_dump(const char *reason)
+{
+  if (!gc_stats_path)
+    return;
+  else if (!strcmp(gc_stats_path, "-"))
+  {
+    gc_stats_json(stderr, reason);
+    return;
+  }
+
+  FILE *fp = fopen(gc_stats_path, "a");
+  if (!fp)
+  {
+    fprintf(stderr, "GC: failed to open '%s' for stats\n", gc_stats_path);
+    return;
+  }
+  gc_stats_json(fp, reason);
+  fclose(fp);
+}
+
+/** Dump stats if SIGUSR1 has been received since we last looked.  Signal
+ * handlers can't safely do IO, so this is polled from the slow path of
+ * `gc_alloc`.
+ */
+static void gc_stats_poll(void)
+{
+  if (!gc_stats_requested)
+    return;
+  gc_stats_requested = 0;
+  gc_stats_dump("signal");
+}
+
+/******************************************************************************
+ * Allocation profiling                                                       *
+ ******************************************************************************/
+
+/// Members of a closure body written out to name its frame.
+#define GC_PROFILE_MEMBERS (6)
+/// Longest stack written for a site, including the allocating function.
+#define GC_PROFILE_STACK_SIZE (4096)
+
+/** Append to the string `buf` of `size` bytes, `*length` of which are used,
+ * truncating once it's full.
+ */
+__attribute__((format(printf, 4, 5))) static void
+gc_profile_append(char *buf, u64 size, u64 *length, const char *fmt, ...)
+{
+  va_list args;
+  va_start(args, fmt);
+  int n = vsnprintf(buf + *length, size - *length, fmt, args);
+  va_end(args);
+  if (n > 0)
+    *length = MIN(size - 1, *length + n);
+}
+
+/** Append a name for the frame computing `body`: its first few members, with
+ * `$x` and `^x` written as they were read.  Nested bodies are elided.
+ */
+static void gc_profile_name(char *buf, u64 size, u64 *length, obj_t *body)
+{
+  if (IS_CODE(body))
+    body = as_code(body)->source;
+
+  gc_profile_append(buf, size, length, "(");
+  u64 members = 0;
+  for (obj_t *iter = body; IS_PAIR(iter); iter = DIRECT_CDR(iter), ++members)
+  {
+    if (members == GC_PROFILE_MEMBERS)
+    {
+      gc_profile_append(buf, size, length, " ...");
+      break;
+    }
+    else if (members)
+      gc_profile_append(buf, size, length, " ");
+
+    obj_t *cmd = DIRECT_CAR(iter);
+    if (cmd == state->atom_quote && IS_PAIR(DIRECT_CDR(iter)))
+    {
+      iter        = DIRECT_CDR(iter);
+      cmd         = DIRECT_CAR(iter);
+      obj_t *next = DIRECT_CDR(iter);
+      char prefix = '\'';
+      if (IS_ATOM(cmd) && IS_PAIR(next) && DIRECT_CAR(next) == state->atom_pop)
+        prefix = '$';
+      else if (IS_ATOM(cmd) && IS_PAIR(next) &&
+               DIRECT_CAR(next) == state->atom_push)
+        prefix = '^';
+      if (prefix != '\'')
+        iter = next;
+      gc_profile_append(buf, size, length, "%c", prefix);
+    }
+
+    switch (get_tag(cmd))
+    {
+    case TAG_NIL:
+      gc_profile_append(buf, size, length, "()");
+      break;
+    case TAG_ATOM:
+      gc_profile_append(buf, size, length, "%s", as_atom(cmd));
+      break;
+    case TAG_NUM:
+      gc_profile_append(buf, size, length, "%" PRId64, as_num(cmd));
+      break;
+    case TAG_PAIR:
+    case TAG_CODE:
+      gc_profile_append(buf, size, length, "(...)");
+      break;
+    case TAG_CLOS:
+    case TAG_PRIM:
+    default:
+      gc_profile_append(buf, size, length, "?");
+      break;
+    }
+  }
+  gc_profile_append(buf, size, length, ")");
+}
+
+/** Double the slots of the table of sites, putting every site back in.
+ */
+static void gc_profile_table_grow(void)
+{
+  gc_profile_t *profile = &gc->profile;
+  u64 capacity          = MAX(64LU, 2 * profile->table.capacity);
+  u64 *indices          = calloc(capacity, sizeof(*indices));
+  if (!indices)
+    FAIL("GC: failed to allocate sites of the heap profile");
+
+  for (u64 i = 0; i < profile->sites.length; ++i)
+  {
+    u64 slot = profile->sites.items[i].hash & (capacity - 1);
+    while (indices[slot])
+      slot = (slot + 1) & (capacity - 1);
+    indices[slot] = i + 1;
+  }
+
+  free(profile->table.indices);
+  profile->table.indices  = indices;
+  profile->table.capacity = capacity;
+}
+
+/** Index of the site for an allocation by `site` from here, adding it if it's
+ * new.  At most GC_PROFILE_DEPTH of the innermost frames are kept.
+ */
+static u64 gc_profile_site(const char *site)
+{
+  gc_profile_t *profile = &gc->profile;
+  char stack[GC_PROFILE_STACK_SIZE];
+  u64 length = 0;
+  stack[0]   = '\0';
+
+  u64 frames = state->fstack.length;
+  u64 first  = frames > GC_PROFILE_DEPTH ? frames - GC_PROFILE_DEPTH : 0;
+  if (first)
+    gc_profile_append(stack, sizeof(stack), &length, "...;");
+  for (u64 i = first; i < frames; ++i)
+  {
+    gc_profile_name(stack, sizeof(stack), &length,
+                    state->fstack.frames[i].source);
+    gc_profile_append(stack, sizeof(stack), &length, ";");
+  }
+  gc_profile_append(stack, sizeof(stack), &length, "%s", site);
+
+  // FNV-1a
+  u64 hash = 0xcbf29ce484222325;
+  for (u64 i = 0; i < length; ++i)
+    hash = (hash ^ (u8)stack[i]) * 0x100000001b3;
+
+  auto table = &profile->table;
+  if (2 * (profile->sites.length + 1) > table->capacity)
+    gc_profile_table_grow();
+
+  u64 mask = table->capacity - 1;
+  u64 slot = hash & mask;
+  for (; table->indices[slot]; slot = (slot + 1) & mask)
+  {
+    u64 i                    = table->indices[slot] - 1;
+    gc_profile_site_t *other = &profile->sites.items[i];
+    if (other->hash == hash && !strcmp(other->stack, stack))
+      return i;
+  }
+
+  if (profile->sites.length == profile->sites.capacity)
+  {
+    profile->sites.capacity = MAX(64LU, profile->sites.capacity * 2);
+    profile->sites.items =
+        realloc(profile->sites.items,
+                profile->sites.capacity * sizeof(profile->sites.items[0]));
+    if (!profile->sites.items)
+      FAIL("GC: failed to allocate sites of the heap profile");
+  }
+  char *copy = strdup(stack);
+  if (!copy)
+    FAIL("GC: failed to allocate a site of the heap profile");
+  profile->sites.items[profile->sites.length] =
+      (gc_profile_site_t){.stack = copy, .hash = hash};
+  table->indices[slot] = ++profile->sites.length;
+  return profile->sites.length - 1;
+}
+
+/** Number of slots to allocate before the next sample: uniformly between half
+ * and one and a half intervals, so that samples can't fall in step with the
+ * program.
+ */
+static u64 gc_profile_gap(void)
+{
+  gc_profile_t *profile = &gc->profile;
+  // xorshift64
+  profile->seed ^= profile->seed << 13;
+  profile->seed ^= profile->seed >> 7;
+  profile->seed ^= profile->seed << 17;
+  return MAX(1LU, profile->interval / 2 + profile->seed % profile->interval);
+}
+
+/** Sample the allocation `site` is about to make at the top of the nursery.
+ */
+static void gc_profile_sample(const char *site)
+{
+  gc_profile_t *profile = &gc->profile;
+  if (profile->samples.length == profile->samples.capacity)
+  {
+    profile->samples.capacity = MAX(64LU, profile->samples.capacity * 2);
+    profile->samples.items =
+        realloc(profile->samples.items,
+                profile->samples.capacity * sizeof(profile->samples.items[0]));
+    if (!profile->samples.items)
+      FAIL("GC: failed to allocate samples of the heap profile");
+  }
+
+  u64 index = gc_profile_site(site);
+  ++profile->sites.items[index].allocated;
+  profile->samples.items[profile->samples.length++] =
+      (gc_profile_sample_t){.raw = gc->nursery.top, .site = index};
+  profile->next = gc_allocated() + gc_profile_gap();
+}
+
+/** Move every sample to the address `survivor` returns for it, or drop it if
+ * that's NULL (it died).
+ */
+static void gc_profile_retain(void *(*survivor)(void *raw))
+{
+  gc_profile_t *profile = &gc->profile;
+  u64 kept              = 0;
+  for (u64 i = 0; i < profile->samples.length; ++i)
+  {
+    gc_profile_sample_t sample = profile->samples.items[i];
+    sample.raw                 = survivor(sample.raw);
+    if (sample.raw)
+      profile->samples.items[kept++] = sample;
+  }
+  profile->samples.length = kept;
+}
+
+/// Survivors of a minor collection, see `gc_evacuate`.
+static void *gc_profile_promoted(void *raw)
+{
+  if (!gc_is_young(raw))
+    return raw;
+  size_t idx = ((u8 *)raw - gc->nursery.start) / GC_SLOT_SIZE;
+  return bitmap_test(gc->nursery.forwarded, idx) ? ((obj_t **)raw)[0] : NULL;
+}
+
+/// Survivors of a mark.
+static void *gc_profile_marked(void *raw)
+{
+  return bitmap_test(GC_CHUNK_OF(raw)->mark_bits, GC_SLOT_OF(raw)) ? raw
+                                                                   : NULL;
+}
+
+/// Survivors of compaction, see `gc_compact_forward`.
+static void *gc_profile_copied(void *raw)
+{
+  return bitmap_test(GC_CHUNK_OF(raw)->live_bits, GC_SLOT_OF(raw))
+             ? NULL
+             : ((obj_t **)raw)[0];
+}
+
+void gc_profile(const char *path, u64 interval)
+{
+  gc_profile_t *profile = &gc->profile;
+  for (u64 i = 0; i < profile->sites.length; ++i)
+    free(profile->sites.items[i].stack);
+  free(profile->sites.items);
+  free(profile->table.indices);
+  free(profile->samples.items);
+  *profile = (gc_profile_t){0};
+
+  if (path)
+  {
+    profile->path     = path;
+    profile->interval = MAX(1LU, interval / GC_SLOT_SIZE);
+    profile->seed     = gc_clock() | 1;
+    profile->next     = gc_allocated() + gc_profile_gap();
+  }
+  if (gc->nursery.start)
+    gc_nursery_limit();
+}
+
+void gc_profile_dump(void)
+{
+  gc_profile_t *profile = &gc->profile;
+  if (!profile->interval)
+    return;
+
+  FILE *fp = fopen(profile->path, "w");
+  if (!fp)
+  {
+    fprintf(stderr, "GC: failed to open '%s' for the profile\n",
+            profile->path);
+    return;
+  }
+
+  for (u64 i = 0; i < profile->sites.length; ++i)
+    profile->sites.items[i].live = 0;
+  for (u64 i = 0; i < profile->samples.length; ++i)
+    ++profile->sites.items[profile->samples.items[i].site].live;
+
+  // Each sample stands for an interval's worth of allocation.
+  u64 bytes = profile->interval * GC_SLOT_SIZE;
+  for (u64 i = 0; i < profile->sites.length; ++i)
+  {
+    gc_profile_site_t *site = &profile->sites.items[i];
+    if (site->live)
+      fprintf(fp, "live;%s %lu\n", site->stack, site->live * bytes);
+  }
+  for (u64 i = 0; i < profile->sites.length; ++i)
+  {
+    gc_profile_site_t *site = &profile->sites.items[i];
+    fprintf(fp, "allocated;%s %lu\n", site->stack, site->allocated * bytes);
+  }
+  fclose(fp);
+}
+
+/******************************************************************************
+ * Heap snapshots                                                             *
+ ******************************************************************************/
+
+/// File `gc_snapshot_poll` writes to, if any.
+static const char *gc_snapshot_path = NULL;
+/// Set by SIGUSR2, cleared once a snapshot has been written.
+static volatile sig_atomic_t gc_snapshot_requested = 0;
+
+/** Where `gc_snapshot_root` writes roots, and what they're recorded as.
+ */
+static struct
+{
+  FILE *fp;
+  u64 kind, index, count;
+} gc_snapshot_roots;
+
+static void gc_snapshot_root(obj_t **slot)
+{
+  if (!IS_ALLOC(*slot))
+    return;
+  gc_snapshot_root_t root = {.kind  = gc_snapshot_roots.kind,
+                             .index = gc_snapshot_roots.index,
+                             .obj   = *slot};
+  fwrite(&root, sizeof(root), 1, gc_snapshot_roots.fp);
+  ++gc_snapshot_roots.count;
+}
+
+static void gc_snapshot_root_as(gc_snapshot_kind_t kind, u64 index,
+                                obj_t **slot)
+{
+  gc_snapshot_roots.kind  = kind;
+  gc_snapshot_roots.index = index;
+  gc_snapshot_root(slot);
+}
+
+/** Slots don't know whether they're a pair or a closure, only references to
+ * them do.  Mark the closure `*slot` refers to, if it does.
+ */
+static void gc_snapshot_mark_closure(obj_t **slot)
+{
+  if (!IS_CLOS(*slot))
+    return;
+  void *raw = (void *)UNTAG(*slot);
+  bitmap_set(GC_CHUNK_OF(raw)->mark_bits, GC_SLOT_OF(raw));
+}
+
+void gc_snapshot(const char *path)
+{
+  FILE *fp = fopen(path, "wb");
+  if (!fp)
+  {
+    fprintf(stderr, "GC: failed to open '%s' for a snapshot\n", path);
+    return;
+  }
+
+  // Once everything has been collected and swept, only what's reachable is
+  // live (none of it young), and every mark is clear.
+  gc_collect();
+  gc_sweep();
+
+  gc_visit_roots(gc_snapshot_mark_closure, false);
+  for (u64 i = 0; i < gc->pool.length; ++i)
+  {
+    gc_chunk_t *c = gc->pool.chunks[i];
+    for (size_t w = 0; w < GC_CHUNK_MARK_WORDS; ++w)
+    {
+      for (u64 live = c->live_bits[w]; live; live &= live - 1)
+      {
+        size_t idx     = w * 64 + stdc_trailing_zeros_ull(live);
+        obj_t **fields = (obj_t **)(c->data + idx * GC_SLOT_SIZE);
+        gc_snapshot_mark_closure(&fields[0]);
+        gc_snapshot_mark_closure(&fields[1]);
+      }
+    }
+  }
+
+  // Counts are filled in once everything has been written.
+  gc_snapshot_header_t header = {.slot_size = GC_SLOT_SIZE};
+  memcpy(header.magic, GC_SNAPSHOT_MAGIC, sizeof(header.magic));
+  fwrite(&header, sizeof(header), 1, fp);
+
+  for (u64 i = 0; i < state->atoms.capacity; ++i)
+  {
+    atom_slot_t *slot = &state->atoms.slots[i];
+    if (!slot->atom)
+      continue;
+    gc_snapshot_atom_t name = {.atom = slot->atom, .length = slot->length};
+    fwrite(&name, sizeof(name), 1, fp);
+    fwrite(as_atom(slot->atom), 1, name.length, fp);
+    ++header.atoms;
+  }
+
+  for (u64 i = 0; i < state->codes.length; ++i)
+  {
+    gc_snapshot_code_t code = {.code   = state->codes.items[i],
+                               .source = as_code(state->codes.items[i])->source};
+    fwrite(&code, sizeof(code), 1, fp);
+    ++header.codes;
+  }
+
+  for (u64 i = 0; i < gc->pool.length; ++i)
+  {
+    gc_chunk_t *c = gc->pool.chunks[i];
+    for (size_t w = 0; w < GC_CHUNK_MARK_WORDS; ++w)
+    {
+      for (u64 live = c->live_bits[w]; live; live &= live - 1)
+      {
+        size_t idx     = w * 64 + stdc_trailing_zeros_ull(live);
+        obj_t **fields = (obj_t **)(c->data + idx * GC_SLOT_SIZE);
+        tag_t tag = bitmap_test(c->mark_bits, idx) ? TAG_CLOS : TAG_PAIR;
+        gc_snapshot_object_t object = {.obj    = TAG_CANON(fields, tag),
+                                       .first  = fields[0],
+                                       .second = fields[1]};
+        fwrite(&object, sizeof(object), 1, fp);
+        ++header.objects;
+      }
+    }
+    memset(c->mark_bits, 0, sizeof(c->mark_bits));
+  }
+
+  gc_snapshot_roots.fp    = fp;
+  gc_snapshot_roots.count = 0;
+  for (u64 i = 0; i < state->stack.length; ++i)
+    gc_snapshot_root_as(GC_SNAPSHOT_STACK, i, &state->stack.items[i]);
+  gc_snapshot_root_as(GC_SNAPSHOT_ENV, 0, &state->env);
+  for (u64 i = 0; i < state->fstack.length; ++i)
+  {
+    frame_t *frame = &state->fstack.frames[i];
+    gc_snapshot_root_as(GC_SNAPSHOT_FRAME_BODY, i, &frame->body);
+    gc_snapshot_root_as(GC_SNAPSHOT_FRAME_SOURCE, i, &frame->source);
+    gc_snapshot_root_as(GC_SNAPSHOT_FRAME_ENV, i, &frame->env);
+  }
+  for (u64 i = 0; i < gc->roots.length; ++i)
+    gc_snapshot_root_as(GC_SNAPSHOT_C, i, gc->roots.slots[i]);
+  for (u64 i = 0; i < state->reader->open.length; ++i)
+    gc_snapshot_root_as(GC_SNAPSHOT_READER, i / 3,
+                        &state->reader->open.items[i]);
+  gc_snapshot_root_as(GC_SNAPSHOT_IMAGE, 0, &state->source.forms);
+  gc_snapshot_roots.kind = GC_SNAPSHOT_CODE;
+  for (u64 i = 0; i < state->codes.length; ++i)
+  {
+    gc_snapshot_roots.index = i;
+    code_visit(as_code(state->codes.items[i]), gc_snapshot_root);
+  }
+  header.roots = gc_snapshot_roots.count;
+
+  fseek(fp, 0, SEEK_SET);
+  fwrite(&header, sizeof(header), 1, fp);
+  if (ferror(fp))
+    fprintf(stderr, "GC: failed to write a snapshot to '%s'\n", path);
+  fclose(fp);
+}
+
+static void gc_snapshot_signal(int)
+{
+  gc_snapshot_requested = 1;
+}
+
+void gc_snapshot_on_signal(const char *path)
+{
+  gc_snapshot_path = path;
+  signal(SIGUSR2, path ? gc_snapshot_signal : SIG_DFL);
+}
+
+/** Write a snapshot if SIGUSR2 has been received since we last looked, see
+ * `gc_stats_poll`.
+ */
+static void gc_snapshot_poll(void)
+{
+  if (!gc_snapshot_requested)
+    return;
+  gc_snapshot_requested = 0;
+  gc_snapshot(gc_snapshot_path);
 }
 
 /* Copyright (c) 2024 Anthony Bonkoski
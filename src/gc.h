@@ -1,14 +1,37 @@
-/* gc.h: Pool-based mark-sweep garbage collector for pairs and closures.
+/* gc.h: Generational garbage collector for pairs and closures.
  * Created: 2026-06-21
  * Author: Aryadev Chavali
  * License: See end of file
  *
- * Manages only TAG_PAIR and TAG_CLOS allocations via a non-moving chunked
- * pool.  Atoms, numbers, NIL, and primitives are not managed.
+ * Manages only TAG_PAIR and TAG_CLOS allocations.  Atoms, numbers, NIL, and
+ * primitives are not managed.
  *
- * Roots are registered externally (conservative stack scan, global state,
- * or explicit calls to gc_mark_obj).  Mark/sweep are exposed as separate
- * operations so root providers can plug in freely.
+ * Allocations are made in the nursery, a bump allocated young generation.
+ * When it fills up, a minor collection evacuates whatever is still reachable
+ * into a non-moving chunked pool (the old generation), which is in turn
+ * collected by mark-sweep once it grows past a threshold.  Old objects which
+ * are mutated to point into the nursery must go through `gc_write_barrier`.
+ *
+ * The old generation is allocated in address order by scanning the live
+ * bitmaps of each chunk for free slots.  Sweeping is lazy: a chunk is swept
+ * only once allocation reaches it, and sweeping never touches dead slots.
+ * Chunks are carved out of one large region of virtual memory reserved up
+ * front, so they sit side by side (and can share huge pages).  Chunks left
+ * empty by a mark are given back to the OS, beyond those the next cycle is
+ * expected to need.
+ *
+ * How far the old generation may grow before the next major collection is
+ * decided by a policy, see `gc_growth_t`.
+ *
+ * Roots are precise: global state (operand stack, environment, call frames
+ * and compiled code) plus any C locals registered with `gc_root`.  Mark/sweep
+ * are exposed as separate operations so root providers can plug in freely.
+ * Marking can be split across threads with `gc_mark_threads`, or done
+ * incrementally between allocations with `gc_incremental`.
+ *
+ * Alternatively, with `gc_compact`, major collections copy whatever is
+ * reachable in the old generation into fresh chunks (Cheney's algorithm) and
+ * give the old ones back, so the heap follows the live set.
  */
 
 #ifndef GC_H
@@ -16,41 +39,115 @@
 
 #include "common.h"
 #include "obj.h"
+#include "vec.h"
 
-/** Type for a free slot in the GC.
- * Free slots are arranged in a linked list, and are used to allow re-use of
- * allocations during the sweep phase (which see: `gc_sweep`).
+#include <pthread.h>
 
- * NOTE: An assumption that 16 bits is the consistent slot size is made here to
- * allow this GC to function.
+/// Every allocation is exactly two objects wide.
+#define GC_SLOT_SIZE (sizeof(pair_t))
+static_assert(sizeof(pair_t) == sizeof(clos_t));
 
- * `next_slot`: next free slot in the free list.
- * `chunk_id`: chunk this free slot belongs to.
- * `slot_id`: specific index (slot wise) within the chunk this slot belongs to.
+/** Chunks are GC_CHUNK_SIZE bytes and aligned to GC_CHUNK_SIZE, so the chunk
+ * owning any allocation (and the slot it sits in) is found by masking its
+ * address.
  */
-typedef struct
-{
-  void *next_slot;
-  u32 chunk_id, slot_id;
-} gc_free_slot_t;
-
-#define GC_CHUNK_SLOTS       (1LU << 12)
-#define GC_CHUNK_DATA_SIZE   (sizeof(gc_free_slot_t) * GC_CHUNK_SLOTS)
+#ifndef GC_CHUNK_SHIFT
+#define GC_CHUNK_SHIFT (16)
+#endif
+static_assert(GC_CHUNK_SHIFT >= 10);
+#define GC_CHUNK_SIZE        (1LU << GC_CHUNK_SHIFT)
+#define GC_CHUNK_SLOTS       (GC_CHUNK_SIZE / GC_SLOT_SIZE)
 #define GC_CHUNK_MARK_WORDS  ((GC_CHUNK_SLOTS + 63) / 64)
+#ifndef GC_THRESHOLD_DEFAULT
 #define GC_THRESHOLD_DEFAULT (GC_CHUNK_SLOTS)
+#endif
+/** Growth of the threshold over the live slots: where the adaptive policy
+ * starts, and the bounds it keeps to.
+ */
+#define GC_MULTIPLIER_DEFAULT (2.0)
+#define GC_MULTIPLIER_MIN     (1.5)
+#define GC_MULTIPLIER_MAX     (4.0)
+/// Fraction of run time major collections should take up, at most.
+#ifndef GC_TARGET_DEFAULT
+#define GC_TARGET_DEFAULT (0.05)
+#endif
+#ifndef GC_COMPACT_DEFAULT
+#define GC_COMPACT_DEFAULT (false)
+#endif
+/// Empty chunks kept beyond those the next cycle needs, at the least.
+#define GC_CHUNKS_SLACK (4)
+#define GC_ROOTS_DEFAULT_CAPACITY (1 << 6)
+
+/** Virtual memory reserved for chunks.  Less is reserved if the OS won't give
+ * us this much, and only the chunks in use are backed by memory.  Define
+ * GC_HUGEPAGES to have the region backed by transparent huge pages.
+ */
+#ifndef GC_REGION_SIZE
+#define GC_REGION_SIZE (1LU << 36)
+#endif
+#define GC_HUGEPAGE_SIZE (1LU << 21)
+#define GC_MARK_THREADS_MAX       (64)
+
+/** Objects the mark loads ahead of the one it's marking, by default and at
+ * most, see `gc_mark_prefetch`.  GC_MARK_PREFETCH_MAX is a power of 2.  Off by
+ * default: it only pays off on a scattered heap, and nursery evacuation and
+ * compaction lay objects out in order, where it's a loss.
+ */
+#ifndef GC_MARK_PREFETCH
+#define GC_MARK_PREFETCH (0)
+#endif
+#define GC_MARK_PREFETCH_MAX (16)
+static_assert(GC_MARK_PREFETCH <= GC_MARK_PREFETCH_MAX);
+
+/// Whether to build vector kernels for sweeping, see `gc_sweep_kernel`.
+#ifndef GC_SWEEP_SIMD
+#define GC_SWEEP_SIMD (1)
+#endif
+
+/// Slots allocated between increments of an incremental mark.
+#define GC_INCREMENT_SLOTS (1LU << 12)
+
+/** Mean number of bytes allocated between samples of the allocation profiler,
+ * see `gc_profile`.
+ */
+#ifndef GC_PROFILE_INTERVAL
+#define GC_PROFILE_INTERVAL (1LU << 19)
+#endif
+/// Innermost call frames the allocation profiler records of each sample.
+#define GC_PROFILE_DEPTH (32)
+
+/// Size of the nursery: small enough to stay in cache.
+#ifndef GC_NURSERY_SIZE
+#define GC_NURSERY_SIZE (1LU << 20)
+#endif
+#define GC_NURSERY_SLOTS      (GC_NURSERY_SIZE / GC_SLOT_SIZE)
+#define GC_NURSERY_MARK_WORDS ((GC_NURSERY_SLOTS + 63) / 64)
 
 /** Chunk of memory managed by the GC.
+ * The bitmaps cover every slot of the chunk, but the slots they sit on top of
+ * (those below GC_CHUNK_FIRST_SLOT) are never allocated.
  * `mark_bits`: bitmap for marks across all slots.
  * `live_bits`: bitmap for whether a given slot is live.
  * `data`: raw data where allocations are stored.
  */
-typedef struct
+typedef union
 {
-  u64 mark_bits[GC_CHUNK_MARK_WORDS];
-  u64 live_bits[GC_CHUNK_MARK_WORDS];
-  u8 data[GC_CHUNK_DATA_SIZE];
+  struct
+  {
+    u64 mark_bits[GC_CHUNK_MARK_WORDS];
+    u64 live_bits[GC_CHUNK_MARK_WORDS];
+  };
+  u8 data[GC_CHUNK_SIZE];
 } gc_chunk_t;
 
+#define GC_CHUNK_FIRST_SLOT \
+  ((2 * sizeof(u64) * GC_CHUNK_MARK_WORDS + GC_SLOT_SIZE - 1) / GC_SLOT_SIZE)
+#define GC_CHUNK_USABLE_SLOTS (GC_CHUNK_SLOTS - GC_CHUNK_FIRST_SLOT)
+#define GC_CHUNK_OF(PTR) \
+  ((gc_chunk_t *)((uintptr_t)(PTR) & ~(uintptr_t)(GC_CHUNK_SIZE - 1)))
+#define GC_SLOT_OF(PTR) \
+  (((uintptr_t)(PTR) & (GC_CHUNK_SIZE - 1)) / GC_SLOT_SIZE)
+
 /** Dynamic array of chunks used for stable growth of memory.
  * `length`: number of chunks currently live.
  * `capacity`: number of chunk pointers available to use.
@@ -62,30 +159,304 @@ typedef struct
   gc_chunk_t **chunks;
 } gc_pool_t;
 
+/** Region of virtual memory which chunks are carved out of, in order.
+ * `start`, `end`: bounds of the region.
+ * `next`: first chunk which has never been handed out.
+ * `released`: chunks which have been given back to the OS, to be handed out
+ * again before any new ones.
+ */
+typedef struct
+{
+  u8 *start, *end, *next;
+  gc_pool_t released;
+} gc_region_t;
+
+/** Stack of C locals (`obj_t *` variables) that are roots, see `gc_root`.
+ */
+typedef struct
+{
+  u64 length, capacity;
+  obj_t ***slots;
+} gc_roots_t;
+
+/** Young generation, evacuated by `gc_minor`.
+ * `start`, `end`: bounds of the region.
+ * `top`: next slot to allocate.
+ * `limit`: where allocation next stops to do some work for the GC: the end,
+ * unless an incremental mark is in progress.
+ * `forwarded`: bitmap of slots evacuated during the current minor collection.
+ * The first field of a forwarded slot holds the address of its copy.
+ * `remembered`: old objects which may point into the nursery.
+ * `promoted`: evacuated objects whose fields have yet to be evacuated.
+ */
+typedef struct
+{
+  u8 *start, *end, *top, *limit;
+  u64 forwarded[GC_NURSERY_MARK_WORDS];
+  vec_t remembered, promoted;
+} gc_nursery_t;
+
+/** Pause times of some phase of collection, in nanoseconds.
+ */
+typedef struct
+{
+  u64 count, total, max;
+} gc_pauses_t;
+
+/** Histogram of pauses in nanoseconds, for percentiles in constant space.
+ * Buckets are log-linear: each power of two is split into
+ * 2^GC_HISTOGRAM_SUB_BITS buckets, so a bucket is within 25% of its pauses.
+ */
+#define GC_HISTOGRAM_SUB_BITS (2)
+#define GC_HISTOGRAM_BUCKETS  (64 << GC_HISTOGRAM_SUB_BITS)
+typedef struct
+{
+  u64 count, max;
+  u64 buckets[GC_HISTOGRAM_BUCKETS];
+} gc_histogram_t;
+
+/** A thread taking part in a parallel mark, see `gc_mark_threads`.
+ * `thread`: the thread itself, unused by the collecting thread.
+ * `lock`: guards `shared`.
+ * `shared`: objects to mark which other markers may steal.
+ * `local`: objects to mark which only this marker sees.
+ * `marked`: number of slots this marker has marked.
+ */
+typedef struct
+{
+  pthread_t thread;
+  pthread_mutex_t lock;
+  vec_t shared, local;
+  u64 marked;
+} gc_marker_t;
+
+/** Markers used for parallel marking.
+ * `length`: number of markers, including the collecting thread.  Marking is
+ * sequential when this is below 2.
+ * `markers`: array of markers, the first being the collecting thread.
+ * `start`, `done`: barriers the helper threads meet the collector at, at the
+ * start and end of each mark.
+ * `idle`: number of markers which have run out of work.
+ * `next_root`: marker to give the next root to.
+ * `stopping`: whether helper threads should exit at the next start.
+ */
+typedef struct
+{
+  u64 length;
+  gc_marker_t *markers;
+  pthread_barrier_t start, done;
+  u64 idle;
+  u64 next_root;
+  bool stopping;
+} gc_markers_t;
+
 /** GC metadata used during collection.
- * `alloc_live`: number of live allocations.
- * `alloc_bytes`: number of live allocations in bytes.
- * `threshold`: number of bytes when collection should trigger.
+ * `slots_live`: number of slots in the old generation which were marked by
+ * the last collection, or allocated since.
+ * `slots_live_peak`: most `slots_live` has been at the end of a collection.
+ * `slots_marked`: number of slots marked in the current collection.
+ * `threshold`: number of old slots when a major collection should trigger.
+ * `slots_allocated`: number of slots allocated by the program, up to the last
+ * minor collection.
+ * `slots_freed`: number of old slots found dead by major collections.
+ * `chunks_peak`: most chunks there have been in the pool.
+ * `chunks_released`: number of chunks given back to the OS.
+ * `pauses_*`: pause times for each phase.  A lazy sweep of one chunk, or one
+ * increment of marking, counts as a pause of its own.  Compacting collections
+ * count under `pauses_compact` instead of `pauses_mark`.
+ * `pause_histogram`: pauses of the mutator in `gc_alloc`, which may span
+ * phases.
  */
 typedef struct
 {
   size_t slots_live;
+  size_t slots_live_peak;
+  size_t slots_marked;
   size_t threshold;
-#if DEBUG & DEBUG_GC
   size_t num_collections;
-#endif
+  size_t num_minor_collections;
+  size_t slots_promoted;
+  size_t slots_allocated;
+  size_t slots_freed;
+  size_t chunks_peak;
+  size_t chunks_released;
+  gc_pauses_t pauses_minor, pauses_mark, pauses_sweep, pauses_compact;
+  gc_histogram_t pause_histogram;
 } gc_metadata_t;
 
+/** Incremental marking of the old generation, see `gc_incremental`.
+ * `budget`: time each increment of marking may take, in nanoseconds.  0 if
+ * marking is done all at once.
+ * `marking`: whether a mark is in progress.
+ * `grey`: marked objects whose fields have yet to be marked.
+ */
+typedef struct
+{
+  u64 budget;
+  bool marking;
+  vec_t grey;
+} gc_incremental_t;
+
+/** Where sampled allocations were made: the calls in progress, and the
+ * function which allocated.
+ * `stack`: frames as written by `gc_profile_dump`, outermost first.
+ * `hash`: hash of `stack`.
+ * `allocated`: number of samples taken here.
+ * `live`: number of those which haven't been found dead by a collection, as
+ * of the last `gc_profile_dump`.
+ */
+typedef struct
+{
+  char *stack;
+  u64 hash;
+  u64 allocated, live;
+} gc_profile_site_t;
+
+/** A sampled allocation, weakly referenced: it's followed as it's moved and
+ * dropped once it's found dead.
+ * `raw`: address of the object.
+ * `site`: index of its site in `gc_profile_t`.
+ */
+typedef struct
+{
+  void *raw;
+  u64 site;
+} gc_profile_sample_t;
+
+/** Sampling allocation profiler, see `gc_profile`.
+ * `path`: file the profile is written to.
+ * `interval`: mean number of slots allocated between samples, 0 if not
+ * profiling.
+ * `next`: allocation (counting as `gc_stats_json` does) to sample next.
+ * `seed`: state of the generator which spreads samples out.
+ * `sites`: every site sampled, see `gc_profile_site_t`.
+ * `table`: index + 1 of every site, 0 if empty, by hash: an open addressing
+ * hash table (with linear probing) of `capacity` slots, a power of 2 kept at
+ * least twice the number of sites.
+ * `samples`: sampled allocations which are still alive.
+ */
+typedef struct
+{
+  const char *path;
+  u64 interval, next, seed;
+  struct
+  {
+    u64 length, capacity;
+    gc_profile_site_t *items;
+  } sites;
+  struct
+  {
+    u64 capacity;
+    u64 *indices;
+  } table;
+  struct
+  {
+    u64 length, capacity;
+    gc_profile_sample_t *items;
+  } samples;
+} gc_profile_t;
+
+/** Heap growth policy: decides the threshold of the next major collection at
+ * the end of each one, see `gc_growth_from_env`.
+ * `name`: what the policy is selected by.
+ * `threshold`: returns the new threshold in slots, given the slots found
+ * `live` and `dead` by the collection.  The initial threshold and maximum
+ * heap are applied on top.
+ */
+typedef struct
+{
+  const char *name;
+  size_t (*threshold)(size_t live, size_t dead);
+} gc_policy_t;
+
+/** Settings and state of heap growth.
+ * `policy`: see `gc_policy_t`.
+ * `initial`: threshold before the first major collection, and the least any
+ * policy may set.
+ * `max`: number of old slots to collect at regardless of policy, 0 if
+ * unlimited.  This is soft: if more than this is live, we collect whenever
+ * another nursery's worth has been promoted.
+ * `target`: fraction of run time major collections should take up.
+ * `multiplier`: growth of the threshold over the live slots.
+ * `since`: time at the end of the last major collection.
+ * `paused`: time paused for major collections (marking, sweeping and
+ * compacting) at that point.
+ */
+typedef struct
+{
+  const gc_policy_t *policy;
+  size_t initial, max;
+  f64 target, multiplier;
+  u64 since, paused;
+} gc_growth_t;
+
+/** Sweep kernel: sweeps the bitmaps of a chunk, see `gc_sweep_kernel`.
+ * `name`: what the kernel is selected by.
+ * `supported`: returns whether this CPU can run it.
+ * `sweep`: drops every unmarked slot from `live` and clears `mark`, both
+ * GC_CHUNK_MARK_WORDS long.  Returns the number of slots dropped.
+ */
+typedef struct
+{
+  const char *name;
+  bool (*supported)(void);
+  size_t (*sweep)(u64 *restrict live, u64 *restrict mark);
+} gc_sweep_kernel_t;
+
+/** Progress of the lazy sweep: chunks `[next, end)` of the pool have yet to be
+ * swept since the last mark.  Chunks created after the mark have nothing to
+ * sweep.
+ * `kernel`: see `gc_sweep_kernel_t`.
+ */
+typedef struct
+{
+  u64 next, end;
+  const gc_sweep_kernel_t *kernel;
+} gc_sweeper_t;
+
+/** Allocation cursor over the old generation, see `gc_alloc_old`.
+ * `chunk`: chunk being allocated from, NULL before the first.
+ * `next_chunk`: index in the pool of the chunk to allocate from after it.
+ * `word`: index of the word of `chunk->live_bits` being allocated from.
+ * `free`: bits of that word which are free to allocate.
+ */
+typedef struct
+{
+  gc_chunk_t *chunk;
+  u64 next_chunk, word, free;
+} gc_cursor_t;
+
 /** General GC data structure.
  * `metadata`: see `gc_metadata_t`.
- * `free_list`: list of "free" i.e. dead allocations.
+ * `cursor`: see `gc_cursor_t`.
  * `pool`: see `gc_pool_t`.
+ * `region`: see `gc_region_t`.
+ * `roots`: see `gc_roots_t`.
+ * `nursery`: see `gc_nursery_t`.
+ * `sweeper`: see `gc_sweeper_t`.
+ * `markers`: see `gc_markers_t`.
+ * `incremental`: see `gc_incremental_t`.
+ * `growth`: see `gc_growth_t`.
+ * `profile`: see `gc_profile_t`.
+ * `prefetch`: objects the mark prefetches ahead, see `gc_mark_prefetch`.
+ * `compact`: whether major collections compact the old generation, see
+ * `gc_compact`.
  */
 typedef struct
 {
   gc_metadata_t metadata;
-  void *free_list;
+  gc_cursor_t cursor;
   gc_pool_t pool;
+  gc_region_t region;
+  gc_roots_t roots;
+  gc_nursery_t nursery;
+  gc_sweeper_t sweeper;
+  gc_markers_t markers;
+  gc_incremental_t incremental;
+  gc_growth_t growth;
+  gc_profile_t profile;
+  u64 prefetch;
+  bool compact;
 } gc_t;
 
 /** Initialise the GC.
@@ -102,30 +473,220 @@ void gc_stop(void);
  */
 void gc_reset(void);
 
-/** Allocate a new slot in the GC.
+/** Allocate a new slot in the GC, initialised to `first` and `second`.
+ * `site` names the function allocating, for `gc_profile`.
  * NOTE: Returns a pointer to exactly two objects.
  */
-__attribute__((noinline)) obj_t **gc_alloc();
+__attribute__((noinline)) obj_t **gc_alloc(obj_t *first, obj_t *second,
+                                           const char *site);
+
+/** Allocate `count` slots in the old generation at once, in new chunks put in
+ * `chunks` (of which there are `count` over GC_CHUNK_USABLE_SLOTS, rounded
+ * up).  Slot i is slot GC_CHUNK_FIRST_SLOT + i % GC_CHUNK_USABLE_SLOTS of
+ * chunk i / GC_CHUNK_USABLE_SLOTS.  This never collects, and every slot is
+ * NIL for the caller to fill in, e.g. loading an image (see fasl.h).
+ */
+void gc_alloc_chunks(u64 count, gc_chunk_t **chunks);
 
-/** Mark an obj_t* as reachable.
- * Call for each root before gc_sweep().
+/** Register the local `*slot` as a root.
+ * Any C code holding an `obj_t *` across an allocation must do this, as the
+ * machine stack is never scanned.  Roots are popped in LIFO order by
+ * `gc_unroot`.
+ */
+void gc_root(obj_t **slot);
+
+/** Pop the last `n` roots registered with `gc_root`.
+ */
+void gc_unroot(size_t n);
+
+/** Record that `obj` has been mutated to point to another object.
+ * This is only needed when mutating an object after its allocation, e.g.
+ * `read_list` appending to a list.
+ */
+void gc_write_barrier(obj_t *obj);
+
+/** Evacuate everything reachable in the nursery into the old generation.
+ */
+void gc_minor(void);
+
+/** Mark with `threads` threads (including the collecting one) from now on.
+ * Helper threads are started here and wait between collections.
+ */
+void gc_mark_threads(u64 threads);
+
+/** Mark incrementally from now on, in increments of at most about `budget_us`
+ * microseconds between allocations.  0 goes back to marking all at once.
+
+ * A mark is started when the threshold is met, then advanced every
+ * GC_INCREMENT_SLOTS allocations.  Once nothing is left to mark, the roots are
+ * marked once more (as they're mutated without barriers) to finish.
+ */
+void gc_incremental(u64 budget_us);
+
+/** Compact the old generation on major collections from now on if `compact`,
+ * otherwise mark and sweep it.  The default is GC_COMPACT_DEFAULT.
+
+ * Every reachable object is copied into new chunks, after which the old chunks
+ * are freed.  Lists are laid out in the order of their cdrs.  Compaction is
+ * done on the collecting thread all at once, so `gc_mark_threads` and
+ * `gc_incremental` have no effect while it's on.
+ */
+void gc_compact(bool compact);
+
+/** Configure heap growth from the environment, FAILing on malformed values.
+ * - FORSP_GC_POLICY: "adaptive" (the default) adjusts the multiplier to keep
+ *   major collections under the target fraction of run time, and raises it
+ *   when collections free little.  "fixed" keeps it at GC_MULTIPLIER_DEFAULT.
+ * - FORSP_GC_INITIAL_HEAP, FORSP_GC_MAX_HEAP: sizes of the old generation in
+ *   bytes, with an optional K, M or G suffix.  See `gc_growth_t`.
+ * - FORSP_GC_TARGET: fraction of run time for major collections, e.g. 0.05.
+ */
+void gc_growth_from_env(void);
+
+/** Mark an obj_t* in the old generation as reachable.
+ * Call for each root before gc_sweep(), after a gc_minor().
  */
 void gc_mark_obj(obj_t *obj);
 
-/** Sweep unmarked slots back into the free list.
+/** Have `gc_mark_obj` prefetch `depth` objects ahead of the one it's marking,
+ * up to GC_MARK_PREFETCH_MAX.  0 marks strictly depth first.
+ */
+void gc_mark_prefetch(u64 depth);
+
+/** Finish sweeping unmarked slots, making them free for allocation.
+ * Sweeping is otherwise done lazily by allocations into the old generation.
  * Returns number freed.
  */
 size_t gc_sweep(void);
 
-/** Performs a complete Mark + Sweep cycle.
- * Returns number freed.
+/** Sweep with the kernel called `name`: one of avx2, sse4.2 or scalar.  NULL
+ * picks the widest this CPU supports, which `gc_init` does.  The vector
+ * kernels are only built for x86-64, and not at all if GC_SWEEP_SIMD is 0.
+ * Returns false, changing nothing, if the kernel isn't available.
+ */
+bool gc_sweep_kernel(const char *name);
+
+/** Performs a complete collection: a minor collection to empty the nursery,
+ * then a Mark cycle of the old generation.  Unmarked slots are swept lazily.
+ * When compacting, the Mark cycle is replaced by a copy (see `gc_compact`).
+ * Returns number of slots found to be dead.
  */
 size_t gc_collect(void);
 
-/** Print some stats for the current state of the GC to FILE.
+/** Print some stats for the current state of the GC to FILE, including
+ * percentiles of pause times.
  */
 void gc_stats(FILE *);
 
+/** Print every counter of the GC to FILE as one line of JSON, tagged with
+ * `reason` and the time in seconds since the epoch.  Pauses are in
+ * nanoseconds and sizes in bytes.
+ */
+void gc_stats_json(FILE *, const char *reason);
+
+/** Append stats as JSON (see `gc_stats_json`) to the file at `path` ("-" for
+ * stderr) whenever SIGUSR1 is received, from now on.  They're written at the
+ * next allocation which needs the GC's attention, so not at all by a program
+ * which has stopped allocating.  NULL stops listening.
+ */
+void gc_stats_on_signal(const char *path);
+
+/** Append stats as JSON to the file given to `gc_stats_on_signal`, if any.
+ */
+void gc_stats_dump(const char *reason);
+
+/** Sample about one in every `interval` bytes allocated from now on, writing a
+ * profile of the samples to the file at `path` after every major collection.
+ * NULL stops profiling, forgetting every sample.
+
+ * Each sample is charged to the function which allocated it (see `make_pair`)
+ * under the closure bodies being computed at the time.  The profile is in the
+ * folded stack format of flamegraph.pl: one line per site, its frames joined
+ * by semicolons, then a count of bytes.  Sites appear once under a root frame
+ * of `live`, for the bytes sampled there which no collection has found dead,
+ * and once under `allocated`, for all bytes sampled there.
+ */
+void gc_profile(const char *path, u64 interval);
+
+/** Write the profile to the file given to `gc_profile` now, if profiling.
+ */
+void gc_profile_dump(void);
+
+/** Heap snapshots, see `gc_snapshot`.
+ * A snapshot is a header followed by its records in the order of its counts,
+ * every field a native u64 (or obj_t *, exactly as it was in the heap):
+ * - `atoms`: every interned atom, each followed by its `length` characters.
+ * - `codes`: every compiled body (as a TAG_CODE object) and its source, so
+ *   closures in the virtual machine can be named.
+ * - `objects`: every live slot, tagged as TAG_PAIR or TAG_CLOS, and its
+ *   fields.
+ * - `roots`: every root holding a pair or closure, by where it's held (see
+ *   `gc_snapshot_kind_t`).
+ */
+#define GC_SNAPSHOT_MAGIC "FORSPHP1"
+typedef struct
+{
+  char magic[8];
+  u64 slot_size;
+  u64 atoms, codes, objects, roots;
+} gc_snapshot_header_t;
+
+typedef struct
+{
+  obj_t *atom;
+  u64 length;
+} gc_snapshot_atom_t;
+
+typedef struct
+{
+  obj_t *code, *source;
+} gc_snapshot_code_t;
+
+typedef struct
+{
+  obj_t *obj, *first, *second;
+} gc_snapshot_object_t;
+
+/** Where a root is held, `index` being:
+ * - GC_SNAPSHOT_STACK: position on the operand stack, from the bottom.
+ * - GC_SNAPSHOT_ENV: unused, it's the top level environment.
+ * - GC_SNAPSHOT_FRAME_*: call frame, from the bottom of the frame stack.
+ * - GC_SNAPSHOT_C: position among the roots registered with `gc_root`.
+ * - GC_SNAPSHOT_CODE: position among the codes of the snapshot.
+ * - GC_SNAPSHOT_READER: nesting of the list being read, from the outermost.
+ * - GC_SNAPSHOT_IMAGE: unused, it's what's left to read of an image.
+ */
+typedef enum
+{
+  GC_SNAPSHOT_STACK,
+  GC_SNAPSHOT_ENV,
+  GC_SNAPSHOT_FRAME_BODY,
+  GC_SNAPSHOT_FRAME_SOURCE,
+  GC_SNAPSHOT_FRAME_ENV,
+  GC_SNAPSHOT_C,
+  GC_SNAPSHOT_CODE,
+  GC_SNAPSHOT_READER,
+  GC_SNAPSHOT_IMAGE,
+} gc_snapshot_kind_t;
+
+typedef struct
+{
+  u64 kind, index;
+  obj_t *obj;
+} gc_snapshot_root_t;
+
+/** Collect the whole heap, then write a snapshot of everything left (see
+ * `gc_snapshot_header_t`) to the file at `path`.  `tools/heap-analyze.c`
+ * reads them.
+ */
+void gc_snapshot(const char *path);
+
+/** Write a snapshot to the file at `path` whenever SIGUSR2 is received, from
+ * now on.  As with `gc_stats_on_signal`, it's written at the next allocation
+ * which needs the GC's attention.  NULL stops listening.
+ */
+void gc_snapshot_on_signal(const char *path);
+
 #endif
 
 /* Copyright (c) 2024 Anthony Bonkoski
@@ -6,67 +6,230 @@
 
 #include "common.h"
 #include "compute.h"
+#include "fasl.h"
 #include "state.h"
 
-static char *load_file(const char *filename, size_t *const size)
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/** Set up the file at `filename` (- for stdin) to be read.  Files are mapped
+ * into memory, while anything else (pipes, terminals) is read as a stream.
+ * Images (see fasl.h) are loaded, and their mapping dropped, straight away.
+ */
+static void load_file(const char *filename)
 {
-  FILE *fp = fopen(filename, "r");
+  FILE *fp = strcmp(filename, "-") ? fopen(filename, "r") : stdin;
   if (!fp)
     FAIL("Failed to open file: '%s'\n", filename);
 
-  fseek(fp, 0, SEEK_END);
-  *size = ftell(fp);
-  fseek(fp, 0, SEEK_SET);
+  struct stat st;
+  if (fstat(fileno(fp), &st))
+    FAIL("Failed to read file: '%s'\n", filename);
+  if (!S_ISREG(st.st_mode))
+  {
+    // Left open for as long as it's read from.
+    read_input_stream(filename, fileno(fp));
+    return;
+  }
 
-  char *mem = malloc(*size + 1);
-  size_t n  = fread(mem, 1, *size, fp);
+  size_t size = st.st_size;
+  void *mem   = NULL;
+  if (size)
+  {
+    // The mapping outlives the file being closed.
+    mem = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+    if (mem == MAP_FAILED)
+      FAIL("Failed to map file: '%s'\n", filename);
+  }
   fclose(fp);
+  if (fasl_is_image(mem, size))
+  {
+    fasl_load(filename, mem, size);
+    munmap(mem, size);
+  }
+  else
+    read_input(filename, mem, size);
+}
 
-  if (n != *size)
-    FAIL("Failed to read file");
+/** Compute each list at the top level of the input in turn, as soon as it's
+ * read, rather than just the first.  Only the list being computed need be
+ * held, and `read` reads whatever follows it.
 
-  mem[*size] = 0;
-  return mem;
+ * Each list is computed under the environment the last left.  A number is
+ * pushed at the end of each, and popped after, so it never ends with a tail
+ * call: its environment is then everything bound at the top level so far.
+ */
+static void compute_incremental(void)
+{
+  obj_t *body = NULL;
+  gc_root(&body);
+  while (read_form(&body))
+  {
+    obj_t *end = make_pair(make_num(0), NULL);
+    if (!body)
+      body = end;
+    else
+    {
+      obj_t *last = body;
+      while (DIRECT_CDR(last))
+        last = DIRECT_CDR(last);
+      DIRECT_CDR(last) = end;
+      gc_write_barrier(last);
+    }
+    state->env = compute(body, state->env);
+    pop();
+  }
+  gc_unroot(1);
 }
 
 // Allocate the state variable in this code unit.
 state_t state[1];
 
+static void usage(const char *program)
+{
+  fprintf(stderr,
+          "usage: %s [-t] [-i] [-c] [-j <threads>] [-f <depth>] [-p <us>] "
+          "[-s] [-S <file>] [-P <file>] [-H <file>] [-o <file>] <path>\n"
+          "\t<path>: program to run, or - to read it from stdin\n"
+          "\t-t: compute with the tree walker instead of the bytecode VM\n"
+          "\t-i: compute every list in <path> in turn as it's read, rather "
+          "than just the first\n"
+          "\t-c: compact the heap on every major collection\n"
+          "\t-j: number of threads to mark with during collection (max %d), "
+          "experimental\n"
+          "\t-f: prefetch <depth> objects ahead while marking (max %d), "
+          "for scattered heaps\n"
+          "\t-p: mark incrementally, pausing for about <us> microseconds at "
+          "a time\n"
+          "\t-s: print statistics of the GC, including pause times, on exit\n"
+          "\t-S: append statistics of the GC as JSON to <file> (- for stderr) "
+          "on exit and SIGUSR1\n"
+          "\t-P: sample allocations, writing a heap profile (folded stacks "
+          "for flamegraph.pl) to <file> after each major collection and on "
+          "exit\n"
+          "\t-H: write a heap snapshot to <file> on SIGUSR2, for "
+          "heap-analyze\n"
+          "\t-o: write an image of <path> to <file>, to run in its place, "
+          "rather than running it\n",
+          program, GC_MARK_THREADS_MAX, GC_MARK_PREFETCH_MAX);
+  exit(1);
+}
+
 int main(int argc, char *argv[])
 {
-  if (argc != 2)
+  bool tree_walk           = false;
+  bool incremental         = false;
+  bool gc_summary          = false;
+  bool compact             = GC_COMPACT_DEFAULT;
+  u64 mark_threads         = 1;
+  u64 prefetch             = GC_MARK_PREFETCH;
+  u64 pause_budget         = 0;
+  const char *stats_path   = NULL;
+  const char *profile_path = NULL;
+  const char *heap_path    = NULL;
+  const char *image_path   = NULL;
+  const char *path         = NULL;
+  for (int i = 1; i < argc; ++i)
   {
-    fprintf(stderr, "usage: %s <path>\n", argv[0]);
-    return 1;
+    if (!strcmp(argv[i], "-t"))
+      tree_walk = true;
+    else if (!strcmp(argv[i], "-i"))
+      incremental = true;
+    else if (!strcmp(argv[i], "-j") && i + 1 < argc)
+    {
+      char *end    = NULL;
+      mark_threads = strtoull(argv[++i], &end, 10);
+      if (*end || mark_threads < 1 || mark_threads > GC_MARK_THREADS_MAX)
+        usage(argv[0]);
+    }
+    else if (!strcmp(argv[i], "-f") && i + 1 < argc)
+    {
+      char *end = NULL;
+      prefetch  = strtoull(argv[++i], &end, 10);
+      if (*end || prefetch > GC_MARK_PREFETCH_MAX)
+        usage(argv[0]);
+    }
+    else if (!strcmp(argv[i], "-p") && i + 1 < argc)
+    {
+      char *end    = NULL;
+      pause_budget = strtoull(argv[++i], &end, 10);
+      if (*end || pause_budget < 1)
+        usage(argv[0]);
+    }
+    else if (!strcmp(argv[i], "-s"))
+      gc_summary = true;
+    else if (!strcmp(argv[i], "-S") && i + 1 < argc)
+      stats_path = argv[++i];
+    else if (!strcmp(argv[i], "-P") && i + 1 < argc)
+      profile_path = argv[++i];
+    else if (!strcmp(argv[i], "-H") && i + 1 < argc)
+      heap_path = argv[++i];
+    else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+      image_path = argv[++i];
+    else if (!strcmp(argv[i], "-c"))
+      compact = true;
+    else if (!path)
+      path = argv[i];
+    else
+      usage(argv[0]);
   }
+  if (!path)
+    usage(argv[0]);
 
   state_init();
-
-  state->input_name = argv[1];
-  state->input_str  = load_file(argv[1], &state->input_len);
-  state->input_pos  = 0;
-
+  state->tree_walk = tree_walk;
+  gc_mark_threads(mark_threads);
+  gc_mark_prefetch(prefetch);
+  gc_incremental(pause_budget);
+  gc_compact(compact);
+  gc_growth_from_env();
+  gc_stats_on_signal(stats_path);
+  gc_profile(profile_path, GC_PROFILE_INTERVAL);
+  gc_snapshot_on_signal(heap_path);
+
+  load_file(path);
+  if (image_path)
+  {
+    FILE *fp = fopen(image_path, "wb");
+    if (!fp)
+      FAIL("Failed to open file: '%s'\n", image_path);
+    fasl_write(fp);
+    if (fclose(fp))
+      FAIL("Failed to write image: '%s'\n", image_path);
+    return 0;
+  }
+  if (incremental)
+    compute_incremental();
+  else
+  {
 #if DEBUG
-  printf("read: starting\n");
+    printf("read: starting\n");
 #endif
-  obj_t *obj = read();
+    obj_t *obj = read();
 #if DEBUG
-  printf("read: finished\n");
+    printf("read: finished\n");
 #if DEBUG & DEBUG_GC
-  printf("GC:read ");
-  gc_stats(stdout);
+    printf("GC:read ");
+    gc_stats(stdout);
 #endif
-  printf("compute: starting\n");
+    printf("compute: starting\n");
 #endif
-  compute(obj, state->env);
+    compute(obj, state->env);
+  }
 
 #if DEBUG & DEBUG_GC
   BORDER();
   printf("GC:exit ");
   gc_stats(stdout);
 #endif
+  if (gc_summary)
+  {
+    fprintf(stderr, "GC:exit ");
+    gc_stats(stderr);
+  }
+  gc_stats_dump("exit");
+  gc_profile_dump();
 
-  // free(state->input_str);
   // state_stop();
 
   return 0;
@@ -8,34 +8,22 @@
 #include "gc.h"
 #include "state.h"
 
-obj_t *make_atom(const char *str, size_t len)
-{
-  char *atom_str = malloc(len + 1);
-  memcpy(atom_str, str, len);
-  atom_str[len] = '\0';
-
-  return TAG_TYPE(atom_str, ATOM);
-}
-
 obj_t *make_num(int64_t num)
 {
   assert(num == ((num << 8) >> 8));
   return TAG_TYPE(num, NUM);
 }
 
-obj_t *make_pair(obj_t *car, obj_t *cdr)
+obj_t *make_pair_from(obj_t *car, obj_t *cdr, const char *site)
 {
-  auto pair = (pair_t *)gc_alloc();
-  pair->car = car;
-  pair->cdr = cdr;
+  // pair_t and clos_t both start with two obj_t* fields
+  auto pair = (pair_t *)gc_alloc(car, cdr, site);
   return TAG_TYPE(pair, PAIR);
 }
 
-obj_t *make_clos(obj_t *body, obj_t *env)
+obj_t *make_clos_from(obj_t *body, obj_t *env, const char *site)
 {
-  auto clos  = (clos_t *)gc_alloc();
-  clos->body = body;
-  clos->env  = env;
+  auto clos = (clos_t *)gc_alloc(body, env, site);
   return TAG_TYPE(clos, CLOS);
 }
 
@@ -44,20 +32,9 @@ obj_t *make_prim(prim_t *func)
   return TAG_TYPE(func, PRIM);
 }
 
-obj_t *intern(const char *atom_buf, size_t atom_len)
+obj_t *make_code(code_t *code)
 {
-  for (u64 i = 0; i < state->interned_atoms.length; ++i)
-  {
-    auto elem      = state->interned_atoms.items[i];
-    auto elem_atom = as_atom(elem);
-    if (atom_len == strlen(elem_atom) &&
-        0 == memcmp(atom_buf, elem_atom, atom_len))
-      return elem;
-  }
-
-  auto atom = make_atom(atom_buf, atom_len);
-  vec_push(&state->interned_atoms, atom);
-  return atom;
+  return TAG_TYPE(code, CODE);
 }
 
 obj_canon_t as_canon(obj_t *obj)
@@ -83,12 +60,123 @@ obj_canon_t as_canon(obj_t *obj)
   case TAG_PRIM:
     return (obj_canon_t){.tag = tag, .as_prim = as_prim(obj)};
     break;
+  case TAG_CODE:
+    return (obj_canon_t){.tag = tag, .as_code = as_code(obj)};
+    break;
   default:
     return (obj_canon_t){0};
     break;
   }
 }
 
+/******************************************************************************
+ * Atoms                                                                      *
+ ******************************************************************************/
+
+/// FNV-1a.
+static u32 atom_hash(const char *str, size_t len)
+{
+  u32 hash = 2166136261u;
+  for (size_t i = 0; i < len; ++i)
+    hash = (hash ^ (u8)str[i]) * 16777619u;
+  return hash;
+}
+
+/** Copy the `len` characters of `str` into the arena as an atom.
+ */
+static obj_t *atom_store(const char *str, size_t len, u32 hash)
+{
+  atoms_t *atoms = &state->atoms;
+  if (len > UINT32_MAX)
+    FAIL("Atom of %lu characters is too long", len);
+  // Room for the NUL, padded so the next header is aligned.
+  size_t size = sizeof(atom_header_t) +
+                (len + sizeof(atom_header_t)) / sizeof(atom_header_t) *
+                    sizeof(atom_header_t);
+  if ((size_t)(atoms->end - atoms->top) < size)
+  {
+    size_t capacity     = MAX(ATOMS_BLOCK_SIZE, size);
+    atom_block_t *block = malloc(sizeof(*block) + capacity);
+    if (!block)
+      FAIL("Failed to allocate memory for atoms");
+    block->prev   = atoms->blocks;
+    atoms->blocks = block;
+    atoms->top    = block->data;
+    atoms->end    = block->data + capacity;
+  }
+
+  atom_header_t *header = (atom_header_t *)atoms->top;
+  char *name            = (char *)(header + 1);
+  atoms->top += size;
+  *header = (atom_header_t){.length = len, .hash = hash};
+  memcpy(name, str, len);
+  name[len] = '\0';
+  return TAG_TYPE(name, ATOM);
+}
+
+/** Double the table of interned atoms, or make it if there isn't one.
+ */
+static void atoms_grow(void)
+{
+  atoms_t *atoms     = &state->atoms;
+  u64 capacity       = MAX(ATOMS_INITIAL_CAPACITY, 2 * atoms->capacity);
+  atom_slot_t *slots = calloc(capacity, sizeof(*slots));
+  if (!slots)
+    FAIL("Failed to allocate memory for atoms");
+
+  for (u64 i = 0; i < atoms->capacity; ++i)
+  {
+    if (!atoms->slots[i].atom)
+      continue;
+    u64 j = atoms->slots[i].hash & (capacity - 1);
+    while (slots[j].atom)
+      j = (j + 1) & (capacity - 1);
+    slots[j] = atoms->slots[i];
+  }
+
+  free(atoms->slots);
+  atoms->slots    = slots;
+  atoms->capacity = capacity;
+}
+
+obj_t *intern(const char *atom_buf, size_t atom_len)
+{
+  atoms_t *atoms = &state->atoms;
+  if (2 * (atoms->length + 1) > atoms->capacity)
+    atoms_grow();
+
+  u32 hash = atom_hash(atom_buf, atom_len);
+  u64 mask = atoms->capacity - 1;
+  for (u64 i = hash & mask;; i = (i + 1) & mask)
+  {
+    atom_slot_t *slot = &atoms->slots[i];
+    if (!slot->atom)
+    {
+      *slot = (atom_slot_t){.hash   = hash,
+                            .length = atom_len,
+                            .atom   = atom_store(atom_buf, atom_len, hash)};
+      ++atoms->length;
+      return slot->atom;
+    }
+    else if (slot->hash == hash && slot->length == atom_len &&
+             !memcmp(as_atom(slot->atom), atom_buf, atom_len))
+      return slot->atom;
+  }
+}
+
+void atoms_stop(void)
+{
+  atoms_t *atoms = &state->atoms;
+  while (atoms->blocks)
+  {
+    atom_block_t *prev = atoms->blocks->prev;
+    free(atoms->blocks);
+    atoms->blocks = prev;
+  }
+  free(atoms->slots);
+  memset(atoms, 0, sizeof(*atoms));
+}
+
 /* Copyright (c) 2024 Anthony Bonkoski
  * Copyright (C) 2026 Aryadev Chavali
 
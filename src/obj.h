@@ -17,9 +17,11 @@ typedef enum Tag
   TAG_PAIR = 3,
   TAG_CLOS = 4,
   TAG_PRIM = 5,
+  TAG_CODE = 6,
 } tag_t;
 
 typedef struct obj obj_t;
+typedef struct code code_t;
 
 #define TAG_CANON(X, T)   ((obj_t *)(((uintptr_t)(X) << 8) | (T)))
 #define TAG_TYPE(X, TYPE) (TAG_CANON(X, TAG_##TYPE))
@@ -32,6 +34,7 @@ typedef struct obj obj_t;
 #define IS_PAIR(obj) (GET_TAG(obj) == TAG_PAIR)
 #define IS_CLOS(obj) (GET_TAG(obj) == TAG_CLOS)
 #define IS_PRIM(obj) (GET_TAG(obj) == TAG_PRIM)
+#define IS_CODE(obj) (GET_TAG(obj) == TAG_CODE)
 
 #define IS_ALLOC(OBJ) (IS_PAIR(OBJ) || IS_CLOS(OBJ))
 
@@ -56,11 +59,15 @@ static inline tag_t get_tag(obj_t *ptr)
   return (tag_t)GET_TAG(ptr);
 }
 
-obj_t *make_atom(const char *str, size_t len);
 obj_t *make_num(int64_t num);
-obj_t *make_pair(obj_t *car, obj_t *cdr);
-obj_t *make_clos(obj_t *body, obj_t *env);
+obj_t *make_pair_from(obj_t *car, obj_t *cdr, const char *site);
+obj_t *make_clos_from(obj_t *body, obj_t *env, const char *site);
 obj_t *make_prim(prim_t *func);
+obj_t *make_code(code_t *code);
+
+/// Allocations are charged to the calling function by the heap profiler.
+#define make_pair(CAR, CDR)  make_pair_from((CAR), (CDR), __func__)
+#define make_clos(BODY, ENV) make_clos_from((BODY), (ENV), __func__)
 
 static inline char *as_atom(obj_t *obj)
 {
@@ -97,6 +104,13 @@ static inline prim_t *as_prim(obj_t *obj)
   return DIRECT_UNTAG(obj, prim_t *);
 }
 
+static inline code_t *as_code(obj_t *obj)
+{
+  if (!IS_CODE(obj))
+    return NULL;
+  return DIRECT_UNTAG(obj, code_t *);
+}
+
 static inline obj_t *car(obj_t *obj)
 {
   auto pair = as_pair(obj);
@@ -114,7 +128,71 @@ static inline bool obj_equal(obj_t *a, obj_t *b)
   return (a == b);
 }
 
+/******************************************************************************
+ * Atoms                                                                      *
+ ******************************************************************************/
+
+/// Size of the blocks the arena for atom names is allocated in.
+#define ATOMS_BLOCK_SIZE (1LU << 16)
+/// Slots the table of interned atoms starts with, a power of 2.
+#define ATOMS_INITIAL_CAPACITY (1LU << 8)
+
+/** Header before the name of every atom in the arena.  An atom points at its
+ * name, which is NUL terminated.
+ * `length`: length of the name.
+ * `hash`: hash of the name, see `intern`.
+ */
+typedef struct
+{
+  u32 length, hash;
+} atom_header_t;
+
+/** Slot of the table of interned atoms.  The hash and length are those of the
+ * atom, kept here so probing only reads the name of a likely match.
+ * `atom`: the interned atom, NULL if the slot is empty.
+ */
+typedef struct
+{
+  u32 hash, length;
+  obj_t *atom;
+} atom_slot_t;
+
+/** Block of the arena for atom names.
+ * `prev`: block allocated before this one.
+ * `data`: headers and names of atoms.
+ */
+typedef struct atom_block
+{
+  struct atom_block *prev;
+  u8 data[];
+} atom_block_t;
+
+/** Interned atoms: an open addressing hash table (with linear probing) over
+ * names stored in an arena.
+ * `length`: atoms in the table.
+ * `capacity`: slots in the table, a power of 2 kept at least twice `length`.
+ * `slots`: the table.
+ * `blocks`: newest block of the arena.
+ * `top`, `end`: free space left in that block.
+ */
+typedef struct
+{
+  u64 length, capacity;
+  atom_slot_t *slots;
+  atom_block_t *blocks;
+  u8 *top, *end;
+} atoms_t;
+
+static inline u64 atom_length(obj_t *obj)
+{
+  return ((atom_header_t *)as_atom(obj))[-1].length;
+}
+
+/** Returns the unique atom named by the `atom_len` characters of `atom_buf`,
+ * making it if it doesn't exist yet.
+ */
 obj_t *intern(const char *atom_buf, size_t atom_len);
+void atoms_stop(void);
 
 typedef struct
 {
@@ -126,6 +204,7 @@ typedef struct
     pair_t as_pair;
     clos_t as_clos;
     prim_t *as_prim;
+    code_t *as_code;
   };
 } obj_canon_t;
 
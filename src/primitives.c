@@ -79,7 +79,16 @@ void prim_print(obj_t **_)
 void prim_stack(obj_t **_)
 {
   (void)_;
-  push(state->stack);
+  // The operand stack is an array, so materialise it as a list (top first).
+  // The list is accumulated in a fresh top slot so it stays reachable by the
+  // GC while we allocate.
+  u64 length = state->stack.length;
+  push(NULL);
+  for (u64 i = 0; i < length; ++i)
+  {
+    state->stack.items[length] =
+        make_pair(state->stack.items[i], state->stack.items[length]);
+  }
 }
 
 void prim_env(obj_t **env)
@@ -127,6 +136,50 @@ void prim_rsh(obj_t **_)
   push(make_num(as_num(a) >> as_num(b)));
 }
 
+void prim_snapshot(obj_t **_)
+{
+  (void)_;
+  auto path = as_atom(pop());
+  if (!path)
+    FAIL("Expected an atom naming the file to write a heap snapshot to");
+  gc_snapshot(path);
+}
+
+/// Open the file named by an atom, or a file descriptor, as a channel.
+void prim_open(obj_t **_)
+{
+  (void)_;
+  auto source = pop();
+  u64 channel;
+  if (IS_NUM(source))
+  {
+    if (as_num(source) < 0 || as_num(source) != (int)as_num(source))
+      FAIL("Expected a file descriptor to open, not %" PRId64, as_num(source));
+    channel = channel_open(NULL, as_num(source));
+  }
+  else if (IS_ATOM(source))
+    channel = channel_open(as_atom(source), -1);
+  else
+    FAIL("Expected an atom naming a file, or a file descriptor, to open");
+  push(make_num(channel));
+}
+
+/// Read the next object from a channel, then whether there was one.
+void prim_read_from(obj_t **_)
+{
+  (void)_;
+  obj_t *obj = NULL;
+  bool more  = channel_read(as_num(pop()), &obj);
+  push(obj);
+  push(more ? state->atom_true : NULL);
+}
+
+void prim_close(obj_t **_)
+{
+  (void)_;
+  channel_close(as_num(pop()));
+}
+
 /* Copyright (c) 2024 Anthony Bonkoski
  * Copyright (C) 2026 Aryadev Chavali
 
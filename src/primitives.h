@@ -33,6 +33,12 @@ void prim_mul(obj_t **_);
 void prim_nand(obj_t **_);
 void prim_lsh(obj_t **_);
 void prim_rsh(obj_t **_);
+void prim_snapshot(obj_t **_);
+
+// channels
+void prim_open(obj_t **_);
+void prim_read_from(obj_t **_);
+void prim_close(obj_t **_);
 
 #endif
 
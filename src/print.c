@@ -4,6 +4,7 @@
  * License: See end of file
  */
 
+#include "compile.h"
 #include "state.h"
 
 void print_recurse(obj_t *obj);
@@ -68,6 +69,10 @@ void print_recurse(obj_t *obj)
     printf("PRIM<%p>", u.ptr);
   }
   break;
+  case TAG_CODE:
+    // Code is printed as the body it was compiled from.
+    print_recurse(as_code(obj)->source);
+    break;
   }
 }
 
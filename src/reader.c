@@ -6,24 +6,84 @@
 
 #include "state.h"
 
-char peek(void)
+#include <errno.h>
+#include <stdbit.h>
+#include <stdckdint.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#if LEX_SIMD && defined(__x86_64__)
+#define LEX_X86 1
+#include <immintrin.h>
+#endif
+
+void reader_init(reader_t *reader)
 {
-  if (state->input_pos == state->input_len)
-    return 0;
-  return state->input_str[state->input_pos];
+  *reader = (reader_t){.block.start = SIZE_MAX, .stream.fd = -1};
+  vec_init(&reader->stack, 3);
+  vec_init(&reader->open, 3);
+}
+
+void reader_stop(reader_t *reader)
+{
+  vec_stop(&reader->stack);
+  vec_stop(&reader->open);
+  free(reader->lines.offsets);
+  free(reader->stream.buffer);
 }
 
-char *stream_current(void)
+void read_input(const char *name, const char *str, size_t len)
 {
-  if (state->input_pos == state->input_len)
+  reader_t *reader       = state->reader;
+  reader->name           = name;
+  reader->str            = str;
+  reader->len            = len;
+  reader->pos            = 0;
+  reader->stream.fd      = -1;
+  reader->stream.offset  = 0;
+  reader->lines.length   = 0;
+  reader->lines.dropped  = 0;
+  reader->lines.scanned  = 0;
+  reader->block.start    = SIZE_MAX;
+  reader->stack.length   = 0;
+  reader->open.length    = 0;
+  reader->forms          = NULL;
+}
+
+void read_input_stream(const char *name, int fd)
+{
+  struct input_stream *stream = &state->reader->stream;
+  if (!stream->buffer)
+  {
+    stream->capacity = READ_STREAM_CHUNK;
+    stream->buffer   = malloc(stream->capacity);
+    if (!stream->buffer)
+      FAIL("Failed to allocate a buffer to read '%s'", name);
+  }
+  read_input(name, stream->buffer, 0);
+  stream->fd = fd;
+}
+
+/// Position of the input in the whole stream it comes from.
+static inline size_t reader_position(void)
+{
+  return state->reader->stream.offset + state->reader->pos;
+}
+
+static bool read_more(void);
+
+char peek(void)
+{
+  reader_t *reader = state->reader;
+  if (reader->pos == reader->len && !read_more())
     return 0;
-  return &state->input_str[state->input_pos];
+  return reader->str[reader->pos];
 }
 
 void advance(void)
 {
   assert(peek());
-  state->input_pos++;
+  state->reader->pos++;
 }
 
 bool is_white(char c)
@@ -42,133 +102,457 @@ bool is_punctuation(char c)
          c == ';';
 }
 
-static const char *WHITESPACE  = "\n\t ";
-static const char *PUNCTUATION = "\'^$();\n\t ";
+/******************************************************************************
+ * Diagnostics                                                                *
+ ******************************************************************************/
 
-void reader_error_position(void)
+static void reader_index_line(size_t start)
 {
-  // Derive col, line from state->input_pos
-  size_t col, line, ind;
-  for (col = 0, line = 1, ind = 0; ind <= state->input_pos; ++ind)
+  struct input_lines *lines = &state->reader->lines;
+  if (lines->length == lines->capacity)
   {
-    if (state->input_str[ind] == '\n')
-    {
-      ++line;
-      col = 0;
-    }
+    lines->capacity = MAX(64LU, lines->capacity * 2);
+    lines->offsets =
+        realloc(lines->offsets, lines->capacity * sizeof(*lines->offsets));
+    if (!lines->offsets)
+      FAIL("Failed to allocate the line index of '%s'", state->reader->name);
+  }
+  lines->offsets[lines->length++] = start;
+}
+
+/** Index the starts of lines in the input at least as far as position `pos`
+ * of the stream.  Input is only ever scanned once, however many diagnostics
+ * are given.
+ */
+static void reader_index_lines(size_t pos)
+{
+  reader_t *reader          = state->reader;
+  struct input_lines *lines = &reader->lines;
+  size_t offset             = reader->stream.offset;
+  size_t end                = offset + reader->len;
+  // The first line starts at 0, and every other just after a newline.
+  if (!lines->length)
+    reader_index_line(0);
+  while (lines->scanned <= pos && lines->scanned < end)
+  {
+    const char *from = reader->str + (lines->scanned - offset);
+    const char *eol  = memchr(from, '\n', end - lines->scanned);
+    lines->scanned   = eol ? offset + (size_t)(eol - reader->str) + 1 : end;
+    if (eol)
+      reader_index_line(lines->scanned);
+  }
+}
+
+/// Index into the line index of the line holding position `pos`.
+static u64 reader_line(size_t pos)
+{
+  reader_index_lines(pos);
+
+  // Last line starting at or before `pos`.
+  struct input_lines *lines = &state->reader->lines;
+  u64 low = 0, high = lines->length;
+  while (high - low > 1)
+  {
+    u64 mid = low + (high - low) / 2;
+    if (lines->offsets[mid] <= pos)
+      low = mid;
     else
-    {
-      ++col;
-    }
+      high = mid;
   }
-  fprintf(stderr, "%s:%lu:%lu: ", state->input_name, line, col);
+  return low;
 }
 
-#define READER_ERROR(...)    \
-  do                         \
-  {                          \
-    reader_error_position(); \
-    FAIL(__VA_ARGS__);       \
+/** Forget the lines of a stream wholly before position `pos`, as nothing
+ * before it will be given a diagnostic.  Lines are still counted.
+ */
+static void reader_drop_lines(size_t pos)
+{
+  struct input_lines *lines = &state->reader->lines;
+  u64 line                  = reader_line(pos);
+  memmove(lines->offsets, lines->offsets + line,
+          (lines->length - line) * sizeof(*lines->offsets));
+  lines->length -= line;
+  lines->dropped += line;
+}
+
+static void reader_error_position(size_t pos)
+{
+  reader_t *reader = state->reader;
+  u64 line         = reader_line(pos);
+  fprintf(stderr, "%s:%lu:%lu: ", reader->name,
+          reader->lines.dropped + line + 1,
+          pos - reader->lines.offsets[line] + 1);
+}
+
+#define READER_ERROR_AT(POS, ...)  \
+  do                               \
+  {                                \
+    reader_error_position((POS));  \
+    FAIL(__VA_ARGS__);             \
   } while (0)
 
-void skip_white_and_comments(void)
+#define READER_ERROR(...) READER_ERROR_AT(reader_position(), __VA_ARGS__)
+
+/******************************************************************************
+ * Streams                                                                    *
+ ******************************************************************************/
+
+/** Read more of a streamed input onto the end of it.  Everything before
+ * the reader's `pos` is dropped first, as it's never looked at again, so the
+ * input moves back to start there.  Lexing which may go past the end of the
+ * input calls this, then carries on from where it was relative to `pos`.
+ * Returns false at the end of the stream, or if the input isn't a stream.
+ */
+static bool read_more(void)
 {
-  if (peek() == 0)
+  reader_t *reader            = state->reader;
+  struct input_stream *stream = &reader->stream;
+  if (stream->fd < 0)
+    return false;
+
+  size_t keep = reader->pos;
+  if (keep)
   {
-    return;
+    // Lines are indexed before they're dropped, but lists still being read
+    // may be given a diagnostic from their start.
+    size_t needed = reader_position();
+    reader_index_lines(needed);
+    if (reader->open.length)
+      needed = MIN(needed, (size_t)as_num(reader->open.items[0]));
+    reader_drop_lines(needed);
+
+    reader->len -= keep;
+    memmove(stream->buffer, stream->buffer + keep, reader->len);
+    stream->offset += keep;
+    reader->pos = 0;
   }
+  else if (reader->len == stream->capacity)
+  {
+    // One scalar is filling the whole buffer.
+    stream->capacity *= 2;
+    stream->buffer = realloc(stream->buffer, stream->capacity);
+    if (!stream->buffer)
+      FAIL("Failed to grow the buffer reading '%s'", reader->name);
+  }
+  reader->str         = stream->buffer;
+  reader->block.start = SIZE_MAX;
 
-  state->input_pos += strspn(stream_current(), WHITESPACE);
-  if (peek() == ';')
+  // readv rather than read, which is taken by the reader.
+  struct iovec iov = {.iov_base = stream->buffer + reader->len,
+                      .iov_len  = stream->capacity - reader->len};
+  ssize_t n;
+  do
+    n = readv(stream->fd, &iov, 1);
+  while (n < 0 && errno == EINTR);
+  if (n < 0)
+    FAIL("Failed to read '%s': %s", reader->name, strerror(errno));
+  else if (!n)
   {
-    advance();
-    state->input_pos += strcspn(stream_current(), "\n");
-    skip_white_and_comments();
+    stream->fd = -1;
+    return false;
   }
+  reader->len += n;
+  return true;
 }
 
-static bool parse_i64(const char *str, size_t len, int64_t *_out)
+/******************************************************************************
+ * Lexing                                                                     *
+ ******************************************************************************/
+
+/** Kernels for lexing, see `lex_kernel_t`.
+
+ * A block is classified all at once, so a token in a block already classified
+ * is found with a shift and a count of trailing zeros rather than by looking at
+ * each of its characters.
+ */
+enum
+{
+  LEX_WHITE       = 0b01,
+  LEX_PUNCTUATION = 0b10,
+};
+
+/// Classes of each character, see `is_white` and `is_punctuation`.
+static const u8 lex_classes[256] = {
+    ['\0'] = LEX_PUNCTUATION,
+    ['\t'] = LEX_WHITE | LEX_PUNCTUATION,
+    ['\n'] = LEX_WHITE | LEX_PUNCTUATION,
+    [' ']  = LEX_WHITE | LEX_PUNCTUATION,
+    ['\''] = LEX_PUNCTUATION,
+    ['^']  = LEX_PUNCTUATION,
+    ['$']  = LEX_PUNCTUATION,
+    ['(']  = LEX_PUNCTUATION,
+    [')']  = LEX_PUNCTUATION,
+    [';']  = LEX_PUNCTUATION,
+};
+
+static bool lex_always(void)
 {
-  static char buf[20];
-  memcpy(buf, str, len);
-  buf[len] = '\0';
+  return true;
+}
 
-  int64_t n = atoll(buf);
-  if (n == 0 && strcmp(buf, "0"))
+static void lex_classify_scalar(const char *block, u64 *white,
+                                u64 *punctuation)
+{
+  u64 w = 0, p = 0;
+  for (u64 i = 0; i < LEX_BLOCK; ++i)
   {
-    return false;
+    u8 class = lex_classes[(u8)block[i]];
+    w |= (u64)(class & LEX_WHITE) << i;
+    p |= (u64)(class >> 1) << i;
   }
-  *_out = n;
-  return true;
+  *white       = w;
+  *punctuation = p;
 }
 
-obj_t *read_scalar(void)
+#if LEX_X86
+// SSE2 is part of x86-64, so needs no check.
+static void lex_classify_sse2(const char *block, u64 *white, u64 *punctuation)
+{
+  const char others[] = {'\0', '\'', '^', '$', '(', ')', ';'};
+  u64 w = 0, p = 0;
+  for (u64 i = 0; i < LEX_BLOCK; i += 16)
+  {
+    __m128i c  = _mm_loadu_si128((const __m128i *)(block + i));
+    __m128i ws = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8(' ')),
+                     _mm_cmpeq_epi8(c, _mm_set1_epi8('\t'))),
+        _mm_cmpeq_epi8(c, _mm_set1_epi8('\n')));
+    __m128i ps = ws;
+    for (u64 j = 0; j < ARRSIZE(others); ++j)
+      ps = _mm_or_si128(ps, _mm_cmpeq_epi8(c, _mm_set1_epi8(others[j])));
+    w |= (u64)_mm_movemask_epi8(ws) << i;
+    p |= (u64)_mm_movemask_epi8(ps) << i;
+  }
+  *white       = w;
+  *punctuation = p;
+}
+
+static bool lex_has_avx2(void)
 {
-  size_t size = strcspn(stream_current(), PUNCTUATION);
-  char *str   = stream_current();
-  state->input_pos += size;
+  return __builtin_cpu_supports("avx2");
+}
 
-  int64_t num;
-  if (parse_i64(str, size, &num))
+/** Punctuation is found by looking up each nibble of a character in a table,
+ * `rows` giving a bit for its row of the ASCII table and `cols` the rows its
+ * column has punctuation in.  A character is punctuation if they share a bit:
+ * - row 0: NUL, \t and \n
+ * - row 2: space, $, ', ( and )
+ * - row 3: ;
+ * - row 5: ^
+ */
+[[gnu::target("avx2")]] static void
+lex_classify_avx2(const char *block, u64 *white, u64 *punctuation)
+{
+  const __m256i cols = _mm256_setr_epi8(
+      0x03, 0, 0, 0, 0x02, 0, 0, 0x02, 0x02, 0x03, 0x01, 0x04, 0, 0, 0x08, 0,
+      0x03, 0, 0, 0, 0x02, 0, 0, 0x02, 0x02, 0x03, 0x01, 0x04, 0, 0, 0x08, 0);
+  const __m256i rows = _mm256_setr_epi8(
+      0x01, 0, 0x02, 0x04, 0, 0x08, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, //
+      0x01, 0, 0x02, 0x04, 0, 0x08, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+  const __m256i nibble = _mm256_set1_epi8(0x0F);
+
+  u64 w = 0, p = 0;
+  for (u64 i = 0; i < LEX_BLOCK; i += 32)
   {
-    return make_num(num);
+    __m256i c  = _mm256_loadu_si256((const __m256i *)(block + i));
+    __m256i ws = _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(c, _mm256_set1_epi8(' ')),
+                        _mm256_cmpeq_epi8(c, _mm256_set1_epi8('\t'))),
+        _mm256_cmpeq_epi8(c, _mm256_set1_epi8('\n')));
+    __m256i high = _mm256_and_si256(_mm256_srli_epi16(c, 4), nibble);
+    __m256i low  = _mm256_and_si256(c, nibble);
+    __m256i both = _mm256_and_si256(_mm256_shuffle_epi8(rows, high),
+                                    _mm256_shuffle_epi8(cols, low));
+    __m256i ps   = _mm256_cmpeq_epi8(both, _mm256_setzero_si256());
+    w |= (u64)(u32)_mm256_movemask_epi8(ws) << i;
+    p |= (u64)(u32)~_mm256_movemask_epi8(ps) << i;
   }
-  else
+  *white       = w;
+  *punctuation = p;
+}
+#endif
+
+/// Available kernels, widest first.
+static const lex_kernel_t lex_kernels[] = {
+#if LEX_X86
+    {"avx2", lex_has_avx2, lex_classify_avx2},
+    {"sse2", lex_always, lex_classify_sse2},
+#endif
+    {"scalar", lex_always, lex_classify_scalar},
+};
+
+bool lex_kernel(const char *name)
+{
+  for (u64 i = 0; i < ARRSIZE(lex_kernels); ++i)
   {
-    // NOTE: quite liberal strings.
-    return intern(str, size);
+    const lex_kernel_t *kernel = &lex_kernels[i];
+    if ((!name || !strcmp(name, kernel->name)) && kernel->supported())
+    {
+      state->lexer               = kernel;
+      state->reader->block.start = SIZE_MAX;
+      return true;
+    }
   }
+  return false;
 }
 
-obj_t *read_list(void)
+/** Classify the block of input holding `pos`, unless it already is.  The last
+ * block may be short, so it's classified from a copy padded with NUL, which is
+ * punctuation and not whitespace: the input ends any run.
+ */
+static const struct lex_block *lex_block(size_t pos)
 {
-  // NOTE: read_list only called when `(` encountered in read.  Thus, we record
-  // the starting position for diagnostic purposes, then skip ahead.
-  size_t start = state->input_pos;
-  advance();
+  reader_t *reader        = state->reader;
+  struct lex_block *block = &reader->block;
+  size_t start            = pos - pos % LEX_BLOCK;
+  if (block->start == start)
+    return block;
 
-  obj_t *root = NULL, *cur = NULL;
-  char c = 0;
+  block->start    = start;
+  const char *str = reader->str + start;
+  if (reader->len - start < LEX_BLOCK)
+  {
+    char tail[LEX_BLOCK] = {0};
+    memcpy(tail, str, reader->len - start);
+    state->lexer->classify(tail, &block->white, &block->punctuation);
+  }
+  else
+    state->lexer->classify(str, &block->white, &block->punctuation);
+  return block;
+}
 
-  skip_white_and_comments();
-  for (c = peek(); (c && c != ')') || state->read_stack.length;
-       skip_white_and_comments(), c = peek())
+/** Position of the end of the run of whitespace (if `white`) or of a scalar
+ * from `pos`, or the end of the input if it gets there first.
+ */
+static inline size_t lex_run(size_t pos, bool white)
+{
+  while (pos < state->reader->len)
+  {
+    const struct lex_block *block = lex_block(pos);
+    u64 end = (white ? ~block->white : block->punctuation) >> (pos % LEX_BLOCK);
+    if (end)
+      return pos + stdc_trailing_zeros(end);
+    pos = block->start + LEX_BLOCK;
+  }
+  return state->reader->len;
+}
+
+size_t lex_word(void)
+{
+  reader_t *reader = state->reader;
+  size_t pos       = lex_run(reader->pos, false);
+  // The scalar may carry on in input that hasn't been read yet.
+  while (pos == reader->len)
   {
-    obj_t *item = read();
-    if (!root)
+    size_t size = pos - reader->pos;
+    if (!read_more())
+      break;
+    pos = lex_run(reader->pos + size, false);
+  }
+  return pos - reader->pos;
+}
+
+void skip_white_and_comments(void)
+{
+  reader_t *reader = state->reader;
+  for (;;)
+  {
+    reader->pos = lex_run(reader->pos, true);
+    if (reader->pos == reader->len)
     {
-      root = make_pair(item, NULL);
-      cur  = root;
+      if (read_more())
+        continue;
+      return;
     }
-    else
+    else if (reader->str[reader->pos] != ';')
+      return;
+
+    // Comments run to the end of their line, which may not be read yet.
+    const char *end;
+    while (!(end = memchr(reader->str + reader->pos, '\n',
+                          reader->len - reader->pos)))
     {
-      pair_t *pair = as_pair(cur);
-      pair->cdr    = make_pair(item, NULL);
-      cur          = pair->cdr;
+      reader->pos = reader->len;
+      if (!read_more())
+        return;
     }
+    reader->pos = end - reader->str;
   }
+}
+
+/** Parse all `len` characters at `str` as a decimal integer, with an optional
+ * sign, into `_out`.  Digits are accumulated as they're checked, in one pass.
+ * Returns false if they aren't one.  Integers too large for a number are an
+ * error.
+
+ * Zero is only ever spelt `0`: as when this went through `atoll`, `-0`, `+0`
+ * or `00` are atoms.
+ */
+static bool parse_i64(const char *str, size_t len, i64 *_out)
+{
+  bool negative = len > 1 && str[0] == '-';
+  size_t i      = len > 1 && (negative || str[0] == '+');
+  if (i == len)
+    return false;
+
+  i64 n         = 0;
+  bool overflow = false;
+  for (; i < len; ++i)
+  {
+    u8 digit = str[i] - '0';
+    if (digit > 9)
+      return false;
+    overflow |= ckd_mul(&n, n, 10) || ckd_add(&n, n, digit);
+  }
+  if (!overflow && !n && len > 1)
+    return false;
+  if (!overflow && negative)
+    n = -n;
+  // Numbers lose their top 8 bits to the tag, see `make_num`.
+  if (overflow || n != ((n << 8) >> 8))
+    READER_ERROR("Integer out of range: %.*s", (int)len, str);
+
+  *_out = n;
+  return true;
+}
+
+obj_t *read_scalar(void)
+{
+  reader_t *reader = state->reader;
+  size_t size      = lex_word();
+  const char *str  = reader->str + reader->pos;
 
-  c = peek();
-  if (c != ')')
+  i64 num;
+  obj_t *scalar;
+  if (parse_i64(str, size, &num))
   {
-    state->input_pos = start;
-    READER_ERROR("Expected closing brace");
+    scalar = make_num(num);
   }
   else
   {
-    advance();
-    return root;
+    // NOTE: quite liberal strings.
+    scalar = intern(str, size);
   }
+  reader->pos += size;
+  return scalar;
 }
 
-obj_t *read(void)
+/******************************************************************************
+ * Parsing                                                                    *
+ ******************************************************************************/
+
+/** Read the next object that isn't a list into `_out`, or begin a list.
+ * Returns false if there's no object yet, having begun a list or deferred the
+ * expansion of `$x` or `^x` onto the reader's `stack`.  Lists are ended by
+ * `read`, so a `)` here is an error.
+ */
+static bool read_token(obj_t **_out)
 {
-  if (state->read_stack.length)
+  if (state->reader->stack.length)
   {
-    obj_t *ret = NULL;
     // NOTE: We've verified length is non zero, but it's best to assert.
-    assert(vec_try_pop(&state->read_stack, &ret));
-    return ret;
+    assert(vec_try_pop(&state->reader->stack, _out));
+    return true;
   }
 
   skip_white_and_comments();
@@ -180,37 +564,203 @@ obj_t *read(void)
     READER_ERROR("End of input: could not read()");
     break;
   case '\'':
-  {
     advance();
-  }
-    return state->atom_quote;
+    *_out = state->atom_quote;
+    return true;
   case '^':
+  case '$':
   {
     advance();
     obj_t *items[3] = {
-        state->atom_push,
+        c == '^' ? state->atom_push : state->atom_pop,
         read_scalar(),
         state->atom_quote,
     };
-    vec_push_mult(&state->read_stack, items, 3);
+    vec_push_mult(&state->reader->stack, items, 3);
   }
-    return read();
-  case '$':
+    return false;
+  case '(':
   {
+    // The list so far is kept as its head and tail, along with where it
+    // started for diagnostics.
+    obj_t *list[3] = {make_num(reader_position()), NULL, NULL};
+    vec_push_mult(&state->reader->open, list, 3);
     advance();
-    obj_t *items[3] = {
-        state->atom_pop,
-        read_scalar(),
-        state->atom_quote,
-    };
-    vec_push_mult(&state->read_stack, items, 3);
   }
-    return read();
-  case '(':
-    return read_list();
+    return false;
+  case ')':
+    READER_ERROR("Unexpected closing brace");
+    break;
   default:
-    return read_scalar();
+    *_out = read_scalar();
+    return true;
   }
+  return false;
+}
+
+/** Read the next object from the input.
+
+ * Lists are read without recursion: every list open at the current position
+ * is kept on the reader's `open`, which the GC treats as a root, so nesting is
+ * only limited by memory.  A list ends once there's nothing deferred on its
+ * `stack` and the next character is `)`.
+ */
+obj_t *read(void)
+{
+  reader_t *reader = state->reader;
+  if (reader->forms)
+  {
+    obj_t *obj    = DIRECT_CAR(reader->forms);
+    reader->forms = DIRECT_CDR(reader->forms);
+    return obj;
+  }
+
+  vec_t *open = &reader->open;
+  u64 base    = open->length;
+  for (;;)
+  {
+    obj_t *item = NULL;
+    if (open->length > base && !state->reader->stack.length)
+    {
+      skip_white_and_comments();
+      if (peek() == ')')
+      {
+        advance();
+        item = open->items[open->length - 2];
+        open->length -= 3;
+      }
+      else if (!peek())
+        READER_ERROR_AT(as_num(open->items[open->length - 3]),
+                        "Expected closing brace");
+      else if (!read_token(&item))
+        continue;
+    }
+    else if (!read_token(&item))
+      continue;
+
+    if (open->length == base)
+      return item;
+
+    obj_t *next  = make_pair(item, NULL);
+    obj_t **list = &open->items[open->length - 3];
+    if (!list[1])
+      list[1] = next;
+    else
+    {
+      // The tail may have been promoted by a collection while making `next`.
+      DIRECT_CDR(list[2]) = next;
+      gc_write_barrier(list[2]);
+    }
+    list[2] = next;
+  }
+}
+
+bool read_next(obj_t **_out)
+{
+  reader_t *reader = state->reader;
+  // Objects may be left over from expanding a `$x` or `^x`.
+  skip_white_and_comments();
+  if (!reader->forms && !reader->stack.length && !peek())
+    return false;
+  *_out = read();
+  return true;
+}
+
+bool read_form(obj_t **_out)
+{
+  if (state->reader->forms)
+  {
+    *_out = read();
+    if (!IS_NIL(*_out) && !IS_PAIR(*_out))
+      FAIL("%s: Expected a list at the top level", state->reader->name);
+    return true;
+  }
+
+  skip_white_and_comments();
+  if (!peek())
+    return false;
+  else if (peek() != '(')
+    READER_ERROR("Expected a list at the top level");
+  *_out = read();
+  return true;
+}
+
+/******************************************************************************
+ * Channels                                                                   *
+ ******************************************************************************/
+
+u64 channel_open(const char *path, int fd)
+{
+  struct channel *channel = calloc(1, sizeof(*channel));
+  if (!channel)
+    FAIL("Failed to allocate a channel");
+  if (path)
+  {
+    channel->file = fopen(path, "r");
+    if (!channel->file)
+      FAIL("Failed to open channel '%s': %s", path, strerror(errno));
+    fd = fileno(channel->file);
+  }
+  else
+  {
+    snprintf(channel->name, sizeof(channel->name), "<fd %d>", fd);
+    // Otherwise a bad descriptor would only show up on the first read, and a
+    // negative one would read as empty.
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st))
+      FAIL("Failed to open channel '%s': %s", channel->name,
+           strerror(fd < 0 ? EBADF : errno));
+  }
+
+  reader_t *reader = state->reader;
+  state->reader    = &channel->reader;
+  reader_init(&channel->reader);
+  read_input_stream(path ? path : channel->name, fd);
+  state->reader = reader;
+
+  // Numbers of closed channels are used again.
+  struct channels *channels = &state->channels;
+  u64 number                = 0;
+  while (number < channels->length && channels->items[number])
+    ++number;
+  if (number == channels->capacity)
+  {
+    channels->capacity = MAX(8LU, channels->capacity * 2);
+    channels->items    = realloc(channels->items,
+                                 channels->capacity * sizeof(*channels->items));
+    if (!channels->items)
+      FAIL("Failed to allocate channels");
+  }
+  if (number == channels->length)
+    ++channels->length;
+  channels->items[number] = channel;
+  return number;
+}
+
+static struct channel *channel_get(u64 number)
+{
+  if (number >= state->channels.length || !state->channels.items[number])
+    FAIL("No channel numbered %lu is open", number);
+  return state->channels.items[number];
+}
+
+bool channel_read(u64 number, obj_t **_out)
+{
+  reader_t *reader = state->reader;
+  state->reader    = &channel_get(number)->reader;
+  bool more        = read_next(_out);
+  state->reader    = reader;
+  return more;
+}
+
+void channel_close(u64 number)
+{
+  struct channel *channel = channel_get(number);
+  reader_stop(&channel->reader);
+  if (channel->file)
+    fclose(channel->file);
+  free(channel);
+  state->channels.items[number] = NULL;
 }
 
 /* Copyright (c) 2024 Anthony Bonkoski
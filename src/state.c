@@ -27,7 +27,10 @@ void state_init()
   state->atom_push  = intern("push", 4);
   state->atom_pop   = intern("pop", 3);
 
-  vec_init(&state->read_stack, 3);
+  state->reader = &state->source;
+  reader_init(state->reader);
+  lex_kernel(NULL);
+  vec_init(&state->stack, STACK_DEFAULT_CAPACITY);
   gc_init();
   frames_init();
   state_env_setup();
@@ -35,14 +38,14 @@ void state_init()
 
 void state_stop()
 {
-  vec_stop(&state->read_stack);
-  for (size_t i = 0; i < state->interned_atoms.length; ++i)
-  {
-    obj_t *oatom = state->interned_atoms.items[i];
-    char *atom   = as_atom(oatom);
-    free(atom);
-  }
-  vec_stop(&state->interned_atoms);
+  for (u64 i = 0; i < state->channels.length; ++i)
+    if (state->channels.items[i])
+      channel_close(i);
+  free(state->channels.items);
+  reader_stop(&state->source);
+  vec_stop(&state->stack);
+  atoms_stop();
+  code_stop();
   gc_stop();
 }
 
@@ -52,19 +55,12 @@ void state_stop()
 
 void push(obj_t *obj)
 {
-  state->stack = make_pair(obj, state->stack);
+  vec_push(&state->stack, obj);
 }
 
 bool try_pop(obj_t **_out)
 {
-  if (!state->stack)
-  {
-    return false;
-  }
-
-  *_out        = DIRECT_CAR(state->stack);
-  state->stack = DIRECT_CDR(state->stack);
-  return true;
+  return vec_try_pop(&state->stack, _out);
 }
 
 obj_t *pop(void)
@@ -99,7 +95,10 @@ obj_t *env_find(obj_t *env, obj_t *key)
 
 obj_t *env_define(obj_t *env, obj_t *key, obj_t *val)
 {
-  return make_pair(make_pair(key, val), env);
+  gc_root(&env);
+  obj_t *kv = make_pair(key, val);
+  gc_unroot(1);
+  return make_pair(kv, env);
 }
 
 /// Constant time table for all the primitives we want to setup.
@@ -132,6 +131,10 @@ const struct PrimRecord RECORDS[] = {
     MAKE_PRIM_RECORD("nand", &prim_nand),
     MAKE_PRIM_RECORD("<<", &prim_lsh),
     MAKE_PRIM_RECORD(">>", &prim_rsh),
+    MAKE_PRIM_RECORD("snapshot", &prim_snapshot),
+    MAKE_PRIM_RECORD("open", &prim_open),
+    MAKE_PRIM_RECORD("read-from", &prim_read_from),
+    MAKE_PRIM_RECORD("close", &prim_close),
 };
 
 void state_env_setup()
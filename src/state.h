@@ -9,34 +9,130 @@
 #define STATE_H
 
 #include "common.h"
+#include "compile.h"
 #include "gc.h"
 #include "obj.h"
 #include "vec.h"
 
 #define FSTACK_DEFAULT_CAPACITY (1 << 7)
+#define STACK_DEFAULT_CAPACITY  (1 << 8)
+
+/** Call frame used by compute.c.
+ * `body`: remaining members of the closure body (tree walker only).
+ * `source`: the whole closure body (tree walker), or its code (VM).  Only
+ * read by the heap profiler.
+ * `env`: environment of the closure being evaluated.
+ * `pc`: next instruction to execute (virtual machine only).
+ * `dynamic`: `env` no longer matches its compiled layout (VM only, see
+ * compile.h).
+ */
+typedef struct frame
+{
+  obj_t *body, *source, *env;
+  const insn_t *pc;
+  bool dynamic;
+} frame_t;
+
+/// Whether to build vector kernels for lexing, see `lex_kernel`.
+#ifndef LEX_SIMD
+#define LEX_SIMD (1)
+#endif
 
-typedef struct state
+/// Characters read from a stream at once, see `read_input_stream`.
+#ifndef READ_STREAM_CHUNK
+#define READ_STREAM_CHUNK (1LU << 16)
+#endif
+
+/// Characters of input classified at once by a lexing kernel.
+#define LEX_BLOCK (64)
+
+/** Lexing kernel: classifies blocks of input, see `lex_kernel`.
+ * `name`: what the kernel is selected by.
+ * `supported`: returns whether this CPU can run it.
+ * `classify`: sets bit i of `white` if character i of the LEX_BLOCK
+ * characters at `block` is whitespace, and of `punctuation` if it ends a
+ * scalar (see `is_punctuation`).
+ */
+typedef struct
+{
+  const char *name;
+  bool (*supported)(void);
+  void (*classify)(const char *block, u64 *white, u64 *punctuation);
+} lex_kernel_t;
+
+/** Input read by `read`: the program, or a channel (see `channel_open`).
+ * `name`: where the input came from, for diagnostics.
+ * `str`: `len` characters of input, not NUL terminated, read up to `pos`.
+ * `block`: block of input last classified by the lexing kernel.
+ * `stack`: objects deferred to be emitted by `read`.
+ * `open`: lists being read, as the start, head and tail of each.
+ * `forms`: objects left to read from an image, as a list (see fasl.h).
+ * `stream`: where more input is read from, if anywhere.
+ * `lines`: starts of lines in the input, for diagnostics.
+ */
+typedef struct reader
 {
-  char *input_name; // name for source of input data
-  char *input_str;  // input data string used by read()
-  size_t input_len; // input data length used by read()
-  size_t input_pos; // input data position used by read()
-  vec_t read_stack; // defered obj to emit from read
+  const char *name;
+  const char *str;
+  size_t len, pos;
+  struct lex_block
+  {
+    size_t start;
+    u64 white, punctuation;
+  } block;
+  vec_t stack, open;
+  obj_t *forms;
+  struct input_stream
+  {
+    int fd;          // -1 if there's no more to read
+    size_t offset;   // position of `str` in the stream
+    size_t capacity; // of `buffer`
+    char *buffer;    // holds `str` while reading a stream
+  } stream;
+  struct input_lines
+  {
+    u64 length, capacity;
+    u64 dropped;    // lines of a stream before `offsets`
+    size_t scanned; // input indexed so far
+    size_t *offsets;
+  } lines;
+} reader_t;
 
-  vec_t interned_atoms; // interned atoms list
+typedef struct state
+{
+  reader_t *reader;          // input being read: `source`, or a channel
+  reader_t source;           // input the program is read from
+  const lex_kernel_t *lexer; // see `lex_kernel_t`
+  struct channels            // data read by `channel_read`, numbered by index
+  {
+    u64 length, capacity;
+    struct channel
+    {
+      reader_t reader;
+      FILE *file;    // NULL if reading a descriptor given to `channel_open`
+      char name[32]; // of a descriptor given to `channel_open`
+    } **items; // NULL once closed
+  } channels;
+
+  atoms_t atoms;        // interned atoms, see `intern`
   obj_t *atom_true;     // atom: t
   obj_t *atom_quote;    // atom: quote
   obj_t *atom_push;     // atom: push
   obj_t *atom_pop;      // atom: pop
 
-  obj_t *stack; // top-of-stack (implemented with pairs)
+  vec_t stack;  // operand stack, top at the end (see `prim_stack` for lists)
   obj_t *env;   // top-level / initial environment
   gc_t gc;      // allocator for pairs/closures
   struct fstack // self-managed dynamic array of call frames - used in compute.c
   {
     u64 length, capacity;
-    clos_t *frames;
+    frame_t *frames;
   } fstack;
+
+  vec_t codes;       // all compiled code, see compile.h
+  vec_t codes_fresh; // code compiled since the last minor collection
+  bool tree_walk; // compute with the tree walker rather than the VM
+
 } state_t;
 
 extern state_t state[1];
@@ -68,7 +164,67 @@ void state_env_setup();
  * Basic I/O                                                                  *
  ******************************************************************************/
 
+/// Set up `reader` with no input, or free everything it holds.
+void reader_init(reader_t *reader);
+void reader_stop(reader_t *reader);
+
+/** Read from the `len` characters at `str` from now on, `name` being where
+ * they came from.
+ */
+void read_input(const char *name, const char *str, size_t len);
+
+/** Read from file descriptor `fd` from now on, a chunk at a time as it's
+ * needed, `name` being where it came from.  Only as much of it as the object
+ * being read is held at once.
+ */
+void read_input_stream(const char *name, int fd);
+
+/** Lex with the kernel called `name`: one of avx2, sse2 or scalar.  NULL picks
+ * the widest this CPU supports, which `state_init` does.  The vector kernels
+ * are only built for x86-64, and not at all if LEX_SIMD is 0.
+ * Returns false, changing nothing, if the kernel isn't available.
+ */
+bool lex_kernel(const char *name);
+
+/// Whether `c` is whitespace, which separates objects.
+bool is_white(char c);
+
+/// Whether `c` ends a scalar.
+bool is_punctuation(char c);
+
+/// Skip past any whitespace and comments in the input.
+void skip_white_and_comments(void);
+
+/// Length of the scalar at the current position of the input.
+size_t lex_word(void);
 obj_t *read(void);
+
+/** Read the next object of the input into `_out`.
+ * Returns false at the end of the input.
+ */
+bool read_next(obj_t **_out);
+
+/** Read the next list at the top level of the input into `_out`.
+ * Returns false at the end of the input.
+ */
+bool read_form(obj_t **_out);
+
+/** Open a channel to read data from, apart from the program: the file at
+ * `path`, or descriptor `fd` if `path` is NULL.  Like a stream, it's read a
+ * chunk at a time, so only as much of it as the object being read is held at
+ * once.  Returns the number of the channel, failing if it can't be opened.
+ * Errors reading it fail too, rather than looking like the end of its input.
+ */
+u64 channel_open(const char *path, int fd);
+
+/** Read the next object from `channel` into `_out`.
+ * Returns false at the end of its input.
+ */
+bool channel_read(u64 channel, obj_t **_out);
+
+/// Close `channel`, and the file it opened, if any.
+void channel_close(u64 channel);
+
 void print(obj_t *obj);
 
 #endif
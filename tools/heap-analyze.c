@@ -0,0 +1,657 @@
+/* heap-analyze.c: Retained sizes and dominator paths from a heap snapshot.
+ * Created: 2026-10-17
+ * Author: Aryadev Chavali
+ * License: See end of file
+ * Commentary:
+
+ * Reads a snapshot written by `gc_snapshot` (see gc.h) and prints the objects
+ * keeping the most memory alive.  An object's retained size is everything
+ * only reachable through it, i.e. everything it dominates.  Each is printed
+ * with its dominators from a root down, so a closure whose environment keeps
+ * a large list alive shows up above the list.  Lists are reported by their
+ * head alone, as each cdr retains almost as much as the cell before it.
+
+ * The graph has a node for each root and each object, under a virtual root.
+ * Dominators are computed with the iterative algorithm of Cooper, Harvey and
+ * Kennedy ("A Simple, Fast Dominance Algorithm").
+ */
+
+#include "common.h"
+#include "gc.h"
+
+#define TOP_DEFAULT (10)
+/// Members of a list printed before eliding the rest.
+#define PREVIEW_MEMBERS (4)
+#define UNDEFINED       (UINT64_MAX)
+
+/******************************************************************************
+ * Address map                                                                *
+ ******************************************************************************/
+
+/** Open addressing map from addresses (never 0) to indices.
+ * `capacity`: number of slots, 2^`bits`.
+ */
+typedef struct
+{
+  u64 capacity, bits;
+  u64 *keys, *values;
+} map_t;
+
+static void map_init(map_t *map, u64 length)
+{
+  for (map->bits = 4; (1LU << map->bits) < length * 2; ++map->bits)
+    continue;
+  map->capacity = 1LU << map->bits;
+  map->keys     = calloc(map->capacity, sizeof(map->keys[0]));
+  map->values   = calloc(map->capacity, sizeof(map->values[0]));
+  if (!map->keys || !map->values)
+    FAIL("Failed to allocate a map of %lu entries", length);
+}
+
+static inline u64 map_slot(const map_t *map, u64 key)
+{
+  // Fibonacci hashing, as addresses are evenly spaced.
+  u64 i = (key * 0x9e3779b97f4a7c15) >> (64 - map->bits);
+  while (map->keys[i] && map->keys[i] != key)
+    i = (i + 1) & (map->capacity - 1);
+  return i;
+}
+
+static void map_put(map_t *map, u64 key, u64 value)
+{
+  u64 i          = map_slot(map, key);
+  map->keys[i]   = key;
+  map->values[i] = value;
+}
+
+static u64 map_get(const map_t *map, u64 key)
+{
+  u64 i = map_slot(map, key);
+  return map->keys[i] ? map->values[i] : UNDEFINED;
+}
+
+/******************************************************************************
+ * Snapshot                                                                   *
+ ******************************************************************************/
+
+/** A snapshot as read from a file, see `gc_snapshot_header_t`.
+ * `names`: name of each atom.
+ * `atoms`, `codes`, `objects`: maps from addresses to indices of their
+ * records.
+ */
+typedef struct
+{
+  gc_snapshot_header_t header;
+  char **names;
+  gc_snapshot_code_t *code_records;
+  gc_snapshot_object_t *object_records;
+  gc_snapshot_root_t *root_records;
+  map_t atoms, codes, objects;
+} snapshot_t;
+
+static void *read_records(FILE *fp, u64 count, u64 size)
+{
+  void *records = calloc(count + 1, size);
+  if (!records)
+    FAIL("Failed to allocate %lu records", count);
+  if (fread(records, size, count, fp) != count)
+    FAIL("Snapshot is truncated");
+  return records;
+}
+
+static void snapshot_load(snapshot_t *snap, const char *path)
+{
+  FILE *fp = fopen(path, "rb");
+  if (!fp)
+    FAIL("Failed to open snapshot: '%s'", path);
+
+  gc_snapshot_header_t *header = &snap->header;
+  if (fread(header, sizeof(*header), 1, fp) != 1 ||
+      memcmp(header->magic, GC_SNAPSHOT_MAGIC, sizeof(header->magic)))
+    FAIL("'%s' is not a heap snapshot", path);
+
+  snap->names = calloc(header->atoms + 1, sizeof(snap->names[0]));
+  map_init(&snap->atoms, header->atoms);
+  for (u64 i = 0; i < header->atoms; ++i)
+  {
+    gc_snapshot_atom_t atom;
+    if (fread(&atom, sizeof(atom), 1, fp) != 1)
+      FAIL("Snapshot is truncated");
+    snap->names[i] = calloc(atom.length + 1, 1);
+    if (fread(snap->names[i], 1, atom.length, fp) != atom.length)
+      FAIL("Snapshot is truncated");
+    map_put(&snap->atoms, UNTAG(atom.atom), i);
+  }
+
+  snap->code_records =
+      read_records(fp, header->codes, sizeof(snap->code_records[0]));
+  map_init(&snap->codes, header->codes);
+  for (u64 i = 0; i < header->codes; ++i)
+    map_put(&snap->codes, UNTAG(snap->code_records[i].code), i);
+
+  snap->object_records =
+      read_records(fp, header->objects, sizeof(snap->object_records[0]));
+  map_init(&snap->objects, header->objects);
+  for (u64 i = 0; i < header->objects; ++i)
+    map_put(&snap->objects, UNTAG(snap->object_records[i].obj), i);
+
+  snap->root_records =
+      read_records(fp, header->roots, sizeof(snap->root_records[0]));
+  fclose(fp);
+}
+
+/// Index of the object record for `obj`, or UNDEFINED if it has none.
+static u64 snapshot_object(const snapshot_t *snap, obj_t *obj)
+{
+  if (!IS_ALLOC(obj))
+    return UNDEFINED;
+  return map_get(&snap->objects, UNTAG(obj));
+}
+
+/******************************************************************************
+ * Printing                                                                   *
+ ******************************************************************************/
+
+static void print_obj(const snapshot_t *snap, obj_t *obj, bool nested);
+
+/** Print the first few members of the list `obj`.
+ */
+static void print_list(const snapshot_t *snap, obj_t *obj)
+{
+  printf("(");
+  for (u64 members = 0; obj; ++members)
+  {
+    u64 index = snapshot_object(snap, obj);
+    if (!IS_PAIR(obj) || index == UNDEFINED)
+    {
+      printf(" . ");
+      print_obj(snap, obj, true);
+      break;
+    }
+    else if (members == PREVIEW_MEMBERS)
+    {
+      printf(" ...");
+      break;
+    }
+    if (members)
+      printf(" ");
+    print_obj(snap, snap->object_records[index].first, true);
+    obj = snap->object_records[index].second;
+  }
+  printf(")");
+}
+
+/** Print `obj` briefly.  Lists inside others (`nested`) are elided down to
+ * their first member if it's an atom, which names bindings in environments.
+ */
+static void print_obj(const snapshot_t *snap, obj_t *obj, bool nested)
+{
+  switch (get_tag(obj))
+  {
+  case TAG_NIL:
+    printf("()");
+    break;
+  case TAG_ATOM:
+  {
+    u64 index = map_get(&snap->atoms, UNTAG(obj));
+    printf("%s", index == UNDEFINED ? "<atom>" : snap->names[index]);
+  }
+  break;
+  case TAG_NUM:
+    printf("%" PRId64, as_num(obj));
+    break;
+  case TAG_PAIR:
+    if (!nested)
+      print_list(snap, obj);
+    else
+    {
+      u64 index = snapshot_object(snap, obj);
+      if (index != UNDEFINED && IS_ATOM(snap->object_records[index].first))
+      {
+        printf("(");
+        print_obj(snap, snap->object_records[index].first, true);
+        printf(" ...)");
+      }
+      else
+        printf("(...)");
+    }
+    break;
+  case TAG_CLOS:
+    if (nested)
+      printf("<closure>");
+    else
+    {
+      // A closure is named by its body, which is code in the VM.
+      u64 index = snapshot_object(snap, obj);
+      obj_t *body =
+          index == UNDEFINED ? NULL : snap->object_records[index].first;
+      u64 code = UNDEFINED;
+      if (IS_CODE(body))
+        code = map_get(&snap->codes, UNTAG(body));
+      if (code != UNDEFINED)
+        body = snap->code_records[code].source;
+      printf("closure ");
+      print_obj(snap, body, false);
+    }
+    break;
+  case TAG_PRIM:
+    printf("<primitive>");
+    break;
+  case TAG_CODE:
+    printf("<code>");
+    break;
+  }
+}
+
+static void print_root(const snapshot_t *snap, const gc_snapshot_root_t *root)
+{
+  switch ((gc_snapshot_kind_t)root->kind)
+  {
+  case GC_SNAPSHOT_STACK:
+    printf("stack[%lu]", root->index);
+    break;
+  case GC_SNAPSHOT_ENV:
+    printf("top level environment");
+    break;
+  case GC_SNAPSHOT_FRAME_BODY:
+    printf("frame[%lu] body", root->index);
+    break;
+  case GC_SNAPSHOT_FRAME_SOURCE:
+    printf("frame[%lu] source", root->index);
+    break;
+  case GC_SNAPSHOT_FRAME_ENV:
+    printf("frame[%lu] environment", root->index);
+    break;
+  case GC_SNAPSHOT_C:
+    printf("C root[%lu]", root->index);
+    break;
+  case GC_SNAPSHOT_CODE:
+    printf("code[%lu] ", root->index);
+    if (root->index < snap->header.codes)
+      print_obj(snap, snap->code_records[root->index].source, false);
+    break;
+  case GC_SNAPSHOT_READER:
+    printf("list being read[%lu]", root->index);
+    break;
+  case GC_SNAPSHOT_IMAGE:
+    printf("image left to read");
+    break;
+  default:
+    printf("root of kind %lu", root->kind);
+    break;
+  }
+}
+
+static void print_bytes(u64 bytes)
+{
+  if (bytes >= 1LU << 20)
+    printf("%8.1fMiB", bytes / (f64)(1LU << 20));
+  else if (bytes >= 1LU << 10)
+    printf("%8.1fKiB", bytes / (f64)(1LU << 10));
+  else
+    printf("%8luB  ", bytes);
+}
+
+/******************************************************************************
+ * Dominators                                                                 *
+ ******************************************************************************/
+
+/** Object graph of a snapshot.  Node 0 is the virtual root, followed by a node
+ * per root record then per object record.
+ * `length`: number of nodes.
+ * `succ_start`, `succ`: successors of node `n` are `succ[succ_start[n]]` up to
+ * `succ[succ_start[n + 1]]`.  Likewise for predecessors.
+ * `postorder`: number of each node in a postorder from node 0, UNDEFINED if
+ * it's unreachable.
+ * `order`: nodes by their postorder number.
+ * `idom`: immediate dominator of each node.
+ * `retained`: bytes and number of objects each node dominates.
+ */
+typedef struct
+{
+  u64 length, reached;
+  u64 *succ_start, *succ;
+  u64 *pred_start, *pred;
+  u64 *postorder, *order;
+  u64 *idom;
+  u64 *retained, *retained_objects;
+} graph_t;
+
+static inline u64 node_of_object(const snapshot_t *snap, u64 index)
+{
+  return 1 + snap->header.roots + index;
+}
+
+static u64 *alloc_nodes(u64 length)
+{
+  u64 *nodes = calloc(length + 1, sizeof(nodes[0]));
+  if (!nodes)
+    FAIL("Failed to allocate %lu nodes", length);
+  return nodes;
+}
+
+/** Call `edge(graph, from, to)` on every edge of the graph.
+ */
+static void graph_edges(const snapshot_t *snap, graph_t *graph,
+                        void (*edge)(graph_t *, u64, u64))
+{
+  for (u64 i = 0; i < snap->header.roots; ++i)
+  {
+    edge(graph, 0, 1 + i);
+    u64 target = snapshot_object(snap, snap->root_records[i].obj);
+    if (target != UNDEFINED)
+      edge(graph, 1 + i, node_of_object(snap, target));
+  }
+  for (u64 i = 0; i < snap->header.objects; ++i)
+  {
+    u64 node                      = node_of_object(snap, i);
+    gc_snapshot_object_t *object = &snap->object_records[i];
+    u64 first                     = snapshot_object(snap, object->first);
+    u64 second                    = snapshot_object(snap, object->second);
+    if (first != UNDEFINED)
+      edge(graph, node, node_of_object(snap, first));
+    if (second != UNDEFINED)
+      edge(graph, node, node_of_object(snap, second));
+  }
+}
+
+static void count_edge(graph_t *graph, u64 from, u64 to)
+{
+  ++graph->succ_start[from + 1];
+  ++graph->pred_start[to + 1];
+}
+
+static void add_edge(graph_t *graph, u64 from, u64 to)
+{
+  // The starts are used as cursors, then shifted back once every edge is in.
+  graph->succ[graph->succ_start[from]++] = to;
+  graph->pred[graph->pred_start[to]++]  = from;
+}
+
+static void graph_build(const snapshot_t *snap, graph_t *graph)
+{
+  graph->length     = 1 + snap->header.roots + snap->header.objects;
+  graph->succ_start = alloc_nodes(graph->length + 1);
+  graph->pred_start = alloc_nodes(graph->length + 1);
+  graph_edges(snap, graph, count_edge);
+  for (u64 i = 0; i < graph->length; ++i)
+  {
+    graph->succ_start[i + 1] += graph->succ_start[i];
+    graph->pred_start[i + 1] += graph->pred_start[i];
+  }
+
+  graph->succ = alloc_nodes(graph->succ_start[graph->length]);
+  graph->pred = alloc_nodes(graph->pred_start[graph->length]);
+  graph_edges(snap, graph, add_edge);
+  for (u64 i = graph->length; i > 0; --i)
+  {
+    graph->succ_start[i] = graph->succ_start[i - 1];
+    graph->pred_start[i] = graph->pred_start[i - 1];
+  }
+  graph->succ_start[0] = 0;
+  graph->pred_start[0] = 0;
+}
+
+/** Number the nodes reachable from node 0 in postorder, without recursion:
+ * lists are far deeper than the machine stack.
+ */
+static void graph_postorder(graph_t *graph)
+{
+  graph->postorder = alloc_nodes(graph->length);
+  graph->order     = alloc_nodes(graph->length);
+  u64 *next_edge   = alloc_nodes(graph->length);
+  u64 *stack       = alloc_nodes(graph->length);
+  bool *visited    = calloc(graph->length, sizeof(visited[0]));
+  for (u64 i = 0; i < graph->length; ++i)
+    graph->postorder[i] = UNDEFINED;
+
+  u64 sp = 0, number = 0;
+  stack[sp++] = 0;
+  visited[0]  = true;
+  next_edge[0] = graph->succ_start[0];
+  while (sp > 0)
+  {
+    u64 node = stack[sp - 1];
+    if (next_edge[node] < graph->succ_start[node + 1])
+    {
+      u64 succ = graph->succ[next_edge[node]++];
+      if (visited[succ])
+        continue;
+      visited[succ]   = true;
+      next_edge[succ] = graph->succ_start[succ];
+      stack[sp++]     = succ;
+      continue;
+    }
+    --sp;
+    graph->order[number]  = node;
+    graph->postorder[node] = number++;
+  }
+  graph->reached = number;
+
+  free(next_edge);
+  free(stack);
+  free(visited);
+}
+
+static u64 intersect(const graph_t *graph, u64 a, u64 b)
+{
+  while (a != b)
+  {
+    while (graph->postorder[a] < graph->postorder[b])
+      a = graph->idom[a];
+    while (graph->postorder[b] < graph->postorder[a])
+      b = graph->idom[b];
+  }
+  return a;
+}
+
+static void graph_dominators(graph_t *graph)
+{
+  graph->idom = alloc_nodes(graph->length);
+  for (u64 i = 0; i < graph->length; ++i)
+    graph->idom[i] = UNDEFINED;
+  graph->idom[0] = 0;
+
+  // Reverse postorder, skipping node 0 (numbered last), until nothing changes.
+  for (bool changed = true; changed;)
+  {
+    changed = false;
+    for (u64 i = graph->reached - 1; i > 0; --i)
+    {
+      u64 node     = graph->order[i - 1];
+      u64 new_idom = UNDEFINED;
+      for (u64 e = graph->pred_start[node]; e < graph->pred_start[node + 1];
+           ++e)
+      {
+        u64 pred = graph->pred[e];
+        if (graph->idom[pred] == UNDEFINED)
+          continue;
+        new_idom =
+            new_idom == UNDEFINED ? pred : intersect(graph, pred, new_idom);
+      }
+      if (graph->idom[node] != new_idom)
+      {
+        graph->idom[node] = new_idom;
+        changed           = true;
+      }
+    }
+  }
+}
+
+/** Sum what each node dominates: every node comes before its dominator in
+ * postorder.
+ */
+static void graph_retained(const snapshot_t *snap, graph_t *graph)
+{
+  graph->retained         = alloc_nodes(graph->length);
+  graph->retained_objects = alloc_nodes(graph->length);
+  for (u64 i = 0; i < graph->reached; ++i)
+  {
+    u64 node = graph->order[i];
+    if (node > snap->header.roots)
+    {
+      graph->retained[node] += snap->header.slot_size;
+      ++graph->retained_objects[node];
+    }
+    if (node)
+    {
+      graph->retained[graph->idom[node]] += graph->retained[node];
+      graph->retained_objects[graph->idom[node]] +=
+          graph->retained_objects[node];
+    }
+  }
+}
+
+/******************************************************************************
+ * Report                                                                     *
+ ******************************************************************************/
+
+static void print_node(const snapshot_t *snap, u64 node)
+{
+  if (node <= snap->header.roots)
+    print_root(snap, &snap->root_records[node - 1]);
+  else
+    print_obj(snap, snap->object_records[node - 1 - snap->header.roots].obj,
+              false);
+}
+
+/** Whether `node` is a pair which is the cdr of the pair `parent`.
+ */
+static bool is_tail_of(const snapshot_t *snap, u64 node, u64 parent)
+{
+  if (parent <= snap->header.roots || node <= snap->header.roots)
+    return false;
+  u64 roots = snap->header.roots;
+  gc_snapshot_object_t *p = &snap->object_records[parent - 1 - roots];
+  gc_snapshot_object_t *n = &snap->object_records[node - 1 - roots];
+  return IS_PAIR(p->obj) && IS_PAIR(n->obj) && p->second == n->obj;
+}
+
+/** Print the dominators of `node` from a root down, with runs of list cells
+ * (each the cdr of the last) collapsed.
+ */
+static void print_path(const snapshot_t *snap, const graph_t *graph, u64 node)
+{
+  u64 depth = 0;
+  for (u64 iter = graph->idom[node]; iter; iter = graph->idom[iter])
+    ++depth;
+  u64 *path = alloc_nodes(depth);
+  u64 i     = depth;
+  for (u64 iter = graph->idom[node]; iter; iter = graph->idom[iter])
+    path[--i] = iter;
+
+  // Otherwise the first is a root.
+  bool several = !depth || path[0] > snap->header.roots;
+  if (several)
+    printf("\t\tseveral roots\n");
+  for (i = 0; i < depth; ++i)
+  {
+    bool first = !i && !several;
+    u64 run    = 0;
+    while (i + 1 < depth && is_tail_of(snap, path[i + 1], path[i]))
+      ++i, ++run;
+    printf("\t\t%s", first ? "" : "> ");
+    print_node(snap, path[i]);
+    if (run)
+      printf(" (%lu cdr%s down)", run, run == 1 ? "" : "s");
+    printf("\n");
+  }
+  free(path);
+}
+
+/// Graph `compare_retained` sorts the nodes of.
+static const graph_t *sorting = NULL;
+
+static int compare_retained(const void *a, const void *b)
+{
+  u64 ra = sorting->retained[*(const u64 *)a];
+  u64 rb = sorting->retained[*(const u64 *)b];
+  return ra < rb ? 1 : ra > rb ? -1 : 0;
+}
+
+static void report(const snapshot_t *snap, graph_t *graph, u64 top)
+{
+  printf("%lu objects (", snap->header.objects);
+  print_bytes(snap->header.objects * snap->header.slot_size);
+  printf(") held by %lu roots, %lu unreachable\n", snap->header.roots,
+         graph->length - graph->reached);
+
+  // Every object but the tails of lists, largest first.
+  u64 *candidates = alloc_nodes(snap->header.objects);
+  u64 count       = 0;
+  for (u64 i = 0; i < snap->header.objects; ++i)
+  {
+    u64 node = node_of_object(snap, i);
+    if (graph->idom[node] != UNDEFINED &&
+        !is_tail_of(snap, node, graph->idom[node]))
+      candidates[count++] = node;
+  }
+  sorting = graph;
+  qsort(candidates, count, sizeof(candidates[0]), compare_retained);
+
+  printf("\n%12s %9s  object, then its dominators from a root\n", "retained",
+         "objects");
+  for (u64 i = 0; i < MIN(top, count); ++i)
+  {
+    u64 node = candidates[i];
+    print_bytes(graph->retained[node]);
+    printf(" %9lu  ", graph->retained_objects[node]);
+    print_node(snap, node);
+    printf("\n");
+    print_path(snap, graph, node);
+  }
+  free(candidates);
+}
+
+static void usage(const char *program)
+{
+  fprintf(stderr,
+          "usage: %s [-n <count>] <snapshot>\n"
+          "\t-n: number of objects to report (default %d)\n",
+          program, TOP_DEFAULT);
+  exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+  u64 top          = TOP_DEFAULT;
+  const char *path = NULL;
+  for (int i = 1; i < argc; ++i)
+  {
+    if (!strcmp(argv[i], "-n") && i + 1 < argc)
+    {
+      char *end = NULL;
+      top       = strtoull(argv[++i], &end, 10);
+      if (*end)
+        usage(argv[0]);
+    }
+    else if (!path)
+      path = argv[i];
+    else
+      usage(argv[0]);
+  }
+  if (!path)
+    usage(argv[0]);
+
+  snapshot_t snap = {0};
+  snapshot_load(&snap, path);
+  graph_t graph = {0};
+  graph_build(&snap, &graph);
+  graph_postorder(&graph);
+  graph_dominators(&graph);
+  graph_retained(&snap, &graph);
+  report(&snap, &graph, top);
+  return 0;
+}
+
+/* Copyright (C) 2026 Aryadev Chavali
+
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the MIT License for details.
+
+ * You may distribute and modify this code under the terms of the MIT License,
+ * which you should have received a copy of along with this program.  If not,
+ * please go to <https://opensource.org/license/MIT>.
+
+ */